@@ -1,56 +1,112 @@
 #include "ensemble.h"
 
 #include <exception>
+#include <array>
 #include <algorithm>
 #include <fstream>
 #include <string>
 #include <cmath>
-
-#include <thread>
-
+#include <chrono>
+#include <numeric>
+#include <cstring>
+#include <string_view>
+#include <sstream>
 
 #include "logger.h"
 #include "math_util.h"
+#include "io_util.h"
 
 namespace vis
 {
-	Ensemble::Ensemble(const fs::path& root)
+	Ensemble::Ensemble(const fs::path& root, const fs::path& cache_directory)
+		: _cache_directory{cache_directory},
+		  _pool{std::make_unique<ThreadPool>()}
 	{
-		_num_simulations = count_directories(root);
-		// Load ensemble with a single timestep
-		if(_num_simulations == 0)
-		{
-			_num_simulations = count_files(root);
-			_num_steps = 1;
-			_project_files.reserve(static_cast<size_t>(_num_simulations));
-			std::copy_if(fs::directory_iterator{root}, fs::directory_iterator{}, std::back_inserter(_project_files),
-						 [] (const fs::path& p) { return fs::is_regular_file(p); });
-		}
+		auto manifest = io_util::EnsembleManifest{};
+		auto manifest_path = _cache_directory.empty() ? fs::path{} : io_util::cache_path(_cache_directory, root, ".manifest");
+		if(!manifest_path.empty() && io_util::read_manifest(manifest_path, root, manifest))
+			Logger::debug() << "Ensemble layout has been loaded from manifest " << manifest_path;
 		else
 		{
-			// Load Ensemble with multiple time steps
-			auto not_equal = [] (const auto& a, const auto& b) { return count_files(a) != count_files(b); };
-			if(_num_simulations <= 0
-					|| std::adjacent_find(fs::directory_iterator{root}, fs::directory_iterator{}, not_equal)
-					!= fs::directory_iterator{})	// Search for a subdirectory of root with amount of files not equal to the others
-			{
-				Logger::error() << "Ensemble root directory does not contain subdirectories of the same size. "
-								<< "Path: " << root;
+			manifest = scan_directory(root);
+			if(!manifest_path.empty() && !io_util::write_manifest(manifest_path, root, manifest))
+				Logger::warning() << "Ensemble manifest " << manifest_path << " could not be stored.";
+		}
 
-				throw std::invalid_argument("Path does not follow the expected ensemble directory structure");
-			}
+		_num_simulations = manifest._num_simulations;
+		_num_steps = manifest._num_steps;
+		_project_files = std::move(manifest._files);
+	}
+
+	fs::path Ensemble::default_cache_directory()
+	{
+		return fs::temp_directory_path() / "visualisation";
+	}
+
+	void Ensemble::set_binary_cache(bool enabled)		{ _binary_cache = enabled; }
+
+	void Ensemble::set_streaming(bool enabled)			{ _streaming = enabled; }
+
+	void Ensemble::set_memory_budget(size_t bytes)		{ _memory_budget = bytes; }
+
+	void Ensemble::set_result_cache_limit(std::uintmax_t bytes)	{ _result_cache_limit = bytes; }
+
+	void Ensemble::set_sliding_window(bool enabled)
+	{
+		_sliding_window = enabled;
+		if(!enabled)
+			_sliding_windows.clear();
+	}
+
+	void Ensemble::set_temporal_prefix_sums(bool enabled)
+	{
+		_temporal_prefix_sums = enabled;
+		if(!enabled)
+			_prefix_moments.clear();
+	}
 
-			_num_steps = count_files(*fs::directory_iterator{root});
-			_project_files.reserve(static_cast<size_t>(_num_simulations * _num_steps));	// Class invariant, has to be >= 0
+	void Ensemble::set_batched_gmm(bool enabled)		{ _batched_gmm = enabled; }
+	void Ensemble::set_gmm_warm_start(bool enabled)		{ _gmm_warm_start = enabled; }
+	void Ensemble::set_gmm_accelerated_em(bool enabled)	{ _gmm_accelerated_em = enabled; }
+	void Ensemble::set_gmm_split_search(bool enabled)	{ _gmm_split_search = enabled; }
+	void Ensemble::set_gmm_memoization(bool enabled)	{ _gmm_memoization = enabled; }
+	void Ensemble::set_gmm_random_init(bool enabled)	{ _gmm_random_init = enabled; }
+
+	void Ensemble::set_gmm_components(int count)
+	{
+		if(count < gmm_min_components)
+		{
+			Logger::error() << "GMM analysis needs at least " << gmm_min_components << " components for the GMM renderers, "
+							<< count << " were requested.";
+			throw std::invalid_argument("Invalid number of gmm components");
+		}
+		// The GMM renderers draw exactly gmm_min_components components
+		if(count > gmm_min_components)
+			Logger::warning() << "GMMs with " << count << " components are fitted, but the GMM renderers only draw the first "
+							  << gmm_min_components << " components of each point.";
+		_gmm_components = count;
+	}
 
-			// Copy all directories
-			std::copy_if(fs::recursive_directory_iterator{root}, fs::recursive_directory_iterator{}, std::back_inserter(_project_files),
-						 [] (const fs::path& p) { return fs::is_regular_file(p); });
-			// Sort by path (simulation), then stably by name (timestep)
-			std::sort(_project_files.begin(), _project_files.end());
-			std::stable_sort(_project_files.begin(), _project_files.end(),
-							 [] (const fs::path& a, const fs::path& b) { return a.filename() < b.filename(); });
+	void Ensemble::set_gmm_histogram_bins(int bins)
+	{
+		if(bins < 0)
+		{
+			Logger::error() << "GMM histograms need a positive number of bins, " << bins << " were requested.";
+			throw std::invalid_argument("Invalid number of gmm histogram bins");
 		}
+		_gmm_histogram_bins = bins;
+	}
+
+	void Ensemble::set_gmm_temporal_warm_start(bool enabled)
+	{
+		_gmm_temporal_warm_start = enabled;
+		if(!enabled)
+			_gmm_history.clear();
+	}
+
+	void Ensemble::set_thread_count(size_t thread_count)
+	{
+		_pool = std::make_unique<ThreadPool>(thread_count);
 	}
 
 	int Ensemble::num_steps() const						{ return _num_steps; }
@@ -84,59 +140,18 @@ namespace vis
 			stride = 1;
 
 
-		auto fields = std::vector<std::vector<Field>>(static_cast<size_t>(_num_simulations * count));
-		for(int c = 0; c < count; ++c)
-		{
-			for(int i = 0; i < _num_simulations; ++i)
-			{
-				auto& file = _project_files[static_cast<size_t>((step_index + c * stride) * _num_simulations + i)];
-				auto ifs = std::ifstream{file};
-				auto buff = std::string{};
-				auto line = std::istringstream{};
-
-				// Advance one line
-				std::getline(ifs, buff);
-				line.str(buff);
-
-				// Read layout
-				std::getline(line, buff, ' ');
-				auto width = std::stoi(buff);
-				std::getline(line, buff, ' ');
-				auto height = std::stoi(buff);
-				std::getline(line, buff, ' ');
-				auto depth = std::stoi(buff);
-
-				// Check if total points = volume
-				std::getline(line, buff, ' ');
-				auto total = std::stoi(buff);
-				if(total != width*height*depth)
-				{
-					Logger::error() << "Field in file " << file
-									<< " has invalid dimensions: "
-									<< "width: " << width << " height: " << height << " depth: " << depth << " total:" << total;
-
-					throw std::runtime_error("Total size in simulation header is invalid");
-				}
+		auto files = step_files(step_index, count, stride);
 
-				// Advance one line
-				std::getline(ifs, buff);
-				line.str(buff);
+		auto mtimes = std::vector<std::int64_t>(files.size());
+		std::transform(files.begin(), files.end(), mtimes.begin(), io_util::source_mtime);
+		update_header_cache(files, mtimes);
 
-				// Read number of fields
-				std::getline(line, buff, ' ');
-				fields[static_cast<size_t>(_num_simulations * c + i)].resize(std::stoul(buff), Field(1, width, height, depth));
-				// Read field names
-				for(auto& field : fields[static_cast<size_t>(_num_simulations * c + i)])
-				{
-					std::getline(line, buff, ' ');
-					field.set_name(buff);
-				}
-			}
-		}
+		auto fields = std::vector<const std::vector<Field>*>{};
+		fields.reserve(files.size());
+		for(const auto& file : files)
+			fields.push_back(&_header_cache.at(file.string())._fields);
 
-		// Compares two vectors of fields.
-		// Returns true, if the vectors contain fields of differing layouts at the same index.
-		auto not_equal = [](const auto& va, const auto& vb) { return !std::equal(va.begin(), va.end(), vb.begin(), [](const auto& fa, const auto& fb){ return fa.equal_layout(fb) && fa.name() == fb.name(); }); };
+		auto not_equal = [](const auto* va, const auto* vb) { return !equal_headers(*va, *vb); };
 		if(std::adjacent_find(fields.begin(), fields.end(), not_equal) != fields.end())
 		{
 			Logger::error() << "Ensemble contains fields of differing layout or name.";
@@ -148,8 +163,33 @@ namespace vis
 		_cluster_size = count;
 		_cluster_stride = stride;
 		_headers.clear();
-		_headers.reserve(fields.size());
-		std::copy(fields.front().begin(), fields.front().end(), std::back_inserter(_headers));
+		_headers.reserve(fields.front()->size());
+		std::copy(fields.front()->begin(), fields.front()->end(), std::back_inserter(_headers));
+	}
+
+	void Ensemble::update_header_cache(const std::vector<fs::path>& files, const std::vector<std::int64_t>& mtimes)
+	{
+		// Parse headers of files that are unknown or have been modified since they were parsed
+		auto missing = std::vector<size_t>{};
+		for(size_t f = 0; f < files.size(); ++f)
+		{
+			auto cached = _header_cache.find(files[f].string());
+			if(cached == _header_cache.end() || cached->second._mtime != mtimes[f])
+				missing.push_back(f);
+			// Sliding windows include files outside of the selected steps, so a modified file invalidates them
+			if(cached != _header_cache.end() && cached->second._mtime != mtimes[f])
+				_sliding_windows.clear();
+		}
+
+		auto parsed = std::vector<std::vector<Field>>(missing.size());
+		run_tasks(missing.size(), [&files, &missing, &parsed] (size_t m, size_t) { parsed[m] = io_util::read_member_header(files[missing[m]]); });
+		for(size_t m = 0; m < missing.size(); ++m)
+			_header_cache[files[missing[m]].string()] = {mtimes[missing[m]], std::move(parsed[m])};
+	}
+
+	bool Ensemble::equal_headers(const std::vector<Field>& a, const std::vector<Field>& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const auto& fa, const auto& fb){ return fa.equal_layout(fb) && fa.name() == fb.name(); });
 	}
 
 	void Ensemble::analyse_field(int field_index, Ensemble::Analysis analysis)
@@ -161,139 +201,795 @@ namespace vis
 			throw std::invalid_argument("No field exists at index.");
 		}
 
-		// Read fields from file
-		const auto& layout = _headers[static_cast<size_t>(field_index)];
-		auto fields = std::vector<Field>(static_cast<size_t>(_num_simulations * _cluster_size), Field(layout, true));
+		auto files = step_files(_selected_step, _cluster_size, _cluster_stride);
 
-		for(int c = 0; c < _cluster_size; ++c)
+		// Load the results of an identical analysis. Temporally seeded results depend on earlier analyses, so they are never cached.
+		auto result_key = std::string{};
+		auto result_cache = fs::path{};
+		if(_result_cache_limit != 0 && !_cache_directory.empty() && !(analysis == Analysis::GAUSSIAN_MIXTURE && temporal_seed(field_index)))
 		{
-			for(int i = 0; i < _num_simulations; ++i)
+			result_key = this->result_key(files, field_index, analysis);
+			result_cache = io_util::result_cache_path(_cache_directory, result_key);
+		}
+		if(!result_cache.empty() && io_util::read_result_cache(result_cache, result_key, _fields))
+			Logger::debug() << "Results of field " << _headers[static_cast<size_t>(field_index)].name() << " have been loaded from " << result_cache;
+		else
+		{
+			_fields = run_analysis(files, field_index, analysis);
+			if(!result_cache.empty())
 			{
-				auto ifs = std::ifstream(_project_files[ static_cast<size_t>((_selected_step + c * _cluster_stride) * _num_simulations + i)]);
-				ignore_many(ifs, 3, '\n');	// Skip header
-				ignore_many(ifs, (layout.height()*layout.depth()+1)*field_index, '\n');	// Skip fields
+				if(io_util::write_result_cache(result_cache, result_key, _fields))
+					io_util::evict_result_caches(result_cache.parent_path(), _result_cache_limit);
+				else
+					Logger::warning() << "Result cache " << result_cache << " could not be stored.";
+			}
+		}
 
-				// Read data
-				auto buff = std::string{};
+		// Keep the components, so the next time step can start from them
+		if(analysis == Analysis::GAUSSIAN_MIXTURE && _gmm_temporal_warm_start)
+			_gmm_history[field_index] = _fields;
+	}
 
-				for(int j = 0; j < layout.volume(); ++j)
-				{
-					std::getline(ifs, buff, ' ');
-					fields[static_cast<size_t>(c * _num_simulations + i)].set_value(0, j, std::stof(buff));
-				}
+	std::vector<Field> Ensemble::run_analysis(const std::vector<fs::path>& files, int field_index, Analysis analysis)
+	{
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
 
-				Logger::debug() << "Field " << fields[static_cast<size_t>(c * _num_simulations + i)].name() << " has been read successfully from file "
-								<< _project_files[ static_cast<size_t>((_selected_step + c * _cluster_stride) * _num_simulations + i)];
-			}
+		// Subtract cumulative sums over all time steps, instead of reading the files of the window
+		if(analysis == Analysis::GAUSSIAN_SINGLE && _temporal_prefix_sums)
+		{
+			if(const auto* moments = prefix_moments(field_index))
+				return prefix_gaussian_analysis(*moments, layout);
 		}
 
+		// Update the moments of the last window with the time steps that entered and left it
+		if(analysis == Analysis::GAUSSIAN_SINGLE && _sliding_window)
+			return sliding_gaussian_analysis(field_index);
+
+		// Fold each file into running statistics while it is read, instead of keeping all of them in memory
+		if(analysis == Analysis::GAUSSIAN_SINGLE && _streaming)
+			return streaming_gaussian_analysis(files, field_index);
+
+		// Analyse slabs of rows one after another, if all files do not fit into the memory budget at once
+		auto required_memory = sample_memory(files.size(), static_cast<size_t>(layout.volume()));
+		if(_memory_budget != 0 && required_memory > _memory_budget)
+			return tiled_analysis(files, field_index, analysis);
+
+		auto samples = read_samples(files, field_index, 0, layout.height()*layout.depth());
+
 		// Start analysis
 		switch(analysis)
 		{
 		case Analysis::GAUSSIAN_SINGLE:
-			_fields = gaussian_analysis(fields);
-			break;
+			return gaussian_analysis(samples, layout);
 		case Analysis::GAUSSIAN_MIXTURE:
-			_fields = gaussian_mixture_analysis(fields);
-			break;
+			return gaussian_mixture_analysis(samples, layout, temporal_seed(field_index));
 		}
+		return {};
 	}
 
-	void Ensemble::ignore_many(std::istream& stream, int count, char delimiter)
+	std::string Ensemble::result_key(const std::vector<fs::path>& files, int field_index, Analysis analysis) const
 	{
-		for(int i = 0; i < count; ++i)
-			stream.ignore(std::numeric_limits<std::streamsize>::max(), delimiter);
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+
+		// Every setting that changes the results beyond float rounding, then every analysed file with its modification time
+		auto key = std::ostringstream{};
+		key << "field " << field_index << ' ' << layout.name() << ' ' << layout.width() << ' ' << layout.height() << ' ' << layout.depth()
+			<< "\nanalysis " << static_cast<int>(analysis) << '\n';
+		if(analysis == Analysis::GAUSSIAN_MIXTURE)
+			key << "gmm " << _gmm_components << ' ' << _gmm_histogram_bins << ' ' << _batched_gmm << _gmm_warm_start
+				<< _gmm_accelerated_em << _gmm_split_search << _gmm_random_init << _gmm_memoization << '\n';
+		// The current modification times, files may have been modified since read_headers
+		for(const auto& file : files)
+			key << io_util::source_mtime(file) << ' ' << fs::absolute(file).string() << '\n';
+		return key.str();
 	}
 
-	std::vector<Field> Ensemble::gaussian_analysis(const std::vector<Field>& fields)
+	std::vector<fs::path> Ensemble::step_files(int step_index, int count, int stride) const
 	{
-		if(fields.empty())
+		auto files = std::vector<fs::path>{};
+		files.reserve(static_cast<size_t>(_num_simulations * count));
+		for(int c = 0; c < count; ++c)
+			for(int i = 0; i < _num_simulations; ++i)
+				files.push_back(_project_files[static_cast<size_t>((step_index + c * stride) * _num_simulations + i)]);
+		return files;
+	}
+
+	size_t Ensemble::worker_count() const
+	{
+		return _pool->thread_count();
+	}
+
+	void Ensemble::run_tasks(size_t count, const std::function<void(size_t, size_t)>& task) const
+	{
+		// Tasks are handed out one by one, so slow tasks do not stall a statically assigned range
+		_pool->parallel_for(count, 1, [&task] (size_t begin, size_t end, size_t worker)
+		{
+			for(auto i = begin; i < end; ++i)
+				task(i, worker);
+		});
+	}
+
+	void Ensemble::read_member_field(const fs::path& file, int field_index, Field& field, int first_row) const
+	{
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+		if(_cache_directory.empty())
+		{
+			io_util::read_text_field(file, field_index, layout, first_row, field);
+			return;
+		}
+
+		if(!_binary_cache)
+		{
+			auto num_fields = static_cast<int>(_headers.size());
+			auto lines_per_field = layout.height()*layout.depth();
+			auto index = io_util::cache_path(_cache_directory, file, ".fieldindex");
+			auto extents = std::vector<io_util::FieldExtent>{};
+			if(!io_util::read_field_index(index, file, num_fields, lines_per_field, extents))
+			{
+				extents = io_util::build_field_index(file, num_fields, lines_per_field);
+				if(!io_util::write_field_index(index, file, lines_per_field, extents))
+					Logger::warning() << "Field index for file " << file << " could not be stored.";
+			}
+			io_util::read_text_field(file, extents[static_cast<size_t>(field_index)], first_row, field);
+			return;
+		}
+
+		auto cache = io_util::cache_path(_cache_directory, file, ".fieldcache");
+		if(io_util::read_field_cache(cache, file, field_index, layout, first_row, field))
+			return;
+
+		// Build cache from all fields of the text file
+		if(io_util::write_field_cache(cache, file, _headers)
+				&& io_util::read_field_cache(cache, file, field_index, layout, first_row, field))
+		{
+			Logger::debug() << "Field cache " << cache << " has been built from file " << file;
+			return;
+		}
+
+		Logger::warning() << "Field cache for file " << file << " could not be built, falling back to text parsing.";
+		io_util::read_text_field(file, field_index, layout, first_row, field);
+	}
+
+	size_t Ensemble::sample_memory(size_t num_files, size_t num_points) const
+	{
+		// Every worker that reads a group holds read_group_size staging fields
+		auto num_groups = (num_files + read_group_size - 1) / read_group_size;
+		auto staged_files = std::min(worker_count(), num_groups) * read_group_size;
+		return (num_files + staged_files) * num_points * sizeof(float);
+	}
+
+	SampleMatrix Ensemble::read_samples(const std::vector<fs::path>& files, int field_index, int first_row, int num_rows) const
+	{
+		// Members are read in groups, so each group can be transposed into the matrix in contiguous blocks
+		static constexpr size_t group_size = read_group_size;
+
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+		auto samples = SampleMatrix{layout.width() * num_rows, static_cast<int>(files.size())};
+
+		auto buffer_layout = Field{1, layout.width(), num_rows, 1};
+		buffer_layout.set_name(layout.name());
+		auto num_groups = (files.size() + group_size - 1) / group_size;
+		auto buffers = std::vector<std::vector<Field>>(worker_count());
+		run_tasks(num_groups, [this, &files, &samples, &buffers, &buffer_layout, field_index, first_row] (size_t g, size_t w)
+		{
+			auto first = g * group_size;
+			auto count = std::min(group_size, files.size() - first);
+			if(buffers[w].empty())
+				buffers[w].assign(group_size, Field(buffer_layout, true));
+
+			for(size_t m = 0; m < count; ++m)
+				read_member_field(files[first + m], field_index, buffers[w][m], first_row);
+			samples.set_samples(static_cast<int>(first), buffers[w].data(), buffers[w].data() + count);
+		});
+
+		Logger::debug() << "Field " << layout.name() << " has been read successfully from " << files.size() << " files.";
+
+		return samples;
+	}
+
+	std::vector<Field> Ensemble::gaussian_analysis(const SampleMatrix& samples, const Field& layout) const
+	{
+		if(samples.num_samples() == 0)
 		{
 			Logger::error() << "No data for gaussian analysis.";
 			throw std::invalid_argument("Missing data for gaussian analysis");
 		}
-		const auto& layout = fields.front();
 		auto result = std::vector<Field>(2, Field(1, layout.width(), layout.height(), layout.depth(), true));
 		result[0].set_name(layout.name() + "_mean");
 		result[1].set_name(layout.name() + "_deviation");
 
-		// Set multithreading to maximum hardware concurrency
-		auto thread_count = std::min(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1), result.front().volume());
-		auto threads = std::vector<std::thread>();
-		for(int t = 0; t < thread_count; ++t)
+		// Chunks of points are balanced across the pool. The moments are computed in place, in a single pass over the samples.
+		_pool->parallel_for(static_cast<size_t>(result.front().volume()), gaussian_chunk_size, [&samples, &result] (size_t begin, size_t end, size_t)
+		{
+			for(auto i = static_cast<int>(begin); i < static_cast<int>(end); ++i)
+			{
+				auto moments = math_util::moments(samples.samples(i), static_cast<size_t>(samples.num_samples()));
+				result[0].set_value(0, i, moments._mean);
+				result[1].set_value(0, i, std::sqrt(moments._variance));
+			}
+		});
+
+		Logger::debug() << "Fields " << result[0].name() << " and "<< result[1].name() << " have been calculated successfully.";
+
+		return result;
+	}
+
+	std::vector<Field> Ensemble::tiled_analysis(const std::vector<fs::path>& files, int field_index, Analysis analysis) const
+	{
+		if(files.empty())
+		{
+			Logger::error() << "No data for tiled analysis.";
+			throw std::invalid_argument("Missing data for tiled analysis");
+		}
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+
+		// Rows are contiguous in every field, so a tile of rows is a contiguous range of points
+		auto num_rows = layout.height()*layout.depth();
+		auto row_memory = sample_memory(files.size(), static_cast<size_t>(layout.width()));
+		auto tile_rows = static_cast<int>(std::min(std::max(_memory_budget / row_memory, size_t{1}), static_cast<size_t>(num_rows)));
+		if(_memory_budget < row_memory)
+			Logger::warning() << "Memory budget of " << _memory_budget << " bytes is exceeded by a single row of " << row_memory << " bytes.";
+
+		auto result = std::vector<Field>{};
+		for(int first_row = 0; first_row < num_rows; first_row += tile_rows)
 		{
-			int start = result.front().volume() * t / thread_count;
-			int end = result.front().volume() * (t+1) / thread_count;
-			threads.emplace_back([&fields, &result, start, end] ()
+			auto rows = std::min(tile_rows, num_rows - first_row);
+			auto tile = Field{1, layout.width(), rows, 1};
+			tile.set_name(layout.name());
+
+			auto samples = read_samples(files, field_index, first_row, rows);
+			auto partial = (analysis == Analysis::GAUSSIAN_SINGLE) ? gaussian_analysis(samples, tile)
+																   : gaussian_mixture_analysis(samples, tile, temporal_seed(field_index), first_row * layout.width());
+
+			// Place the tiles results at their position in the whole volume
+			if(result.empty())
 			{
-				for(int i = start; i < end; ++i)
+				for(const auto& part : partial)
 				{
-					auto samples = std::vector<float>();
-					samples.reserve(fields.size());
-					for(const auto& field : fields)
-						samples.push_back(field.get_value(0, i));
-					result[0].set_value(0, i, math_util::mean(samples));
-					result[1].set_value(0, i, std::sqrt(math_util::variance(samples, result[0].get_value(0, i))));
+					result.emplace_back(part.point_dimension(), layout.width(), layout.height(), layout.depth(), true);
+					result.back().set_name(part.name());
 				}
+			}
+			for(size_t r = 0; r < result.size(); ++r)
+				std::copy(partial[r].data().begin(), partial[r].data().end(),
+						  result[r].data().begin() + first_row * layout.width() * result[r].point_dimension());
+
+			Logger::debug() << "Rows [" << first_row << ", " << first_row + rows << ") of field " << layout.name() << " have been analysed.";
+		}
+
+		return result;
+	}
+
+	math_util::RunningMoments Ensemble::running_moments(const std::vector<fs::path>& files, int field_index) const
+	{
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+		auto volume = static_cast<size_t>(layout.volume());
+
+		// One set of running moments and two sets of read buffers, independent of the number of files and threads
+		auto moments = math_util::RunningMoments{};
+		moments._mean.assign(volume, 0.);
+		moments._m2.assign(volume, 0.);
+		if(files.empty())
+			return moments;
+
+		auto group_size = std::min(streaming_read_buffers, files.size());
+		auto num_groups = (files.size() + group_size - 1) / group_size;
+		auto num_chunks = (volume + gaussian_chunk_size - 1) / gaussian_chunk_size;
+		auto buffers = std::array<std::vector<Field>, 2>{std::vector<Field>(group_size, Field(layout, false)),
+														 std::vector<Field>(group_size, Field(layout, false))};
+		auto members = std::vector<const float*>{};
+
+		// Round g reads group g into one set of buffers, while the other tasks of the round fold group g - 1 from the other set.
+		// The files are folded in by disjoint ranges of points, in the order of the files.
+		for(size_t group = 0; group <= num_groups; ++group)
+		{
+			auto& reading = buffers[group % 2];
+			auto first = group * group_size;
+			auto num_reads = group < num_groups ? std::min(group_size, files.size() - first) : 0;
+			auto num_folds = members.empty() ? 0 : num_chunks;
+			run_tasks(num_reads + num_folds, [this, &files, &reading, &moments, &members, first, num_reads, volume, field_index] (size_t t, size_t)
+			{
+				if(t < num_reads)
+				{
+					reading[t].initialize();
+					read_member_field(files[first + t], field_index, reading[t]);
+					return;
+				}
+				auto begin = (t - num_reads) * gaussian_chunk_size;
+				math_util::welford_update(moments, members, begin, std::min(begin + gaussian_chunk_size, volume));
 			});
+			moments._count += static_cast<long>(members.size());
+
+			members.clear();
+			for(size_t b = 0; b < num_reads; ++b)
+				members.push_back(reading[b].data().data());
+		}
+		return moments;
+	}
+
+	std::vector<Field> Ensemble::gaussian_fields(const math_util::RunningMoments& moments, const Field& layout)
+	{
+		auto result = std::vector<Field>(2, Field(1, layout.width(), layout.height(), layout.depth(), true));
+		result[0].set_name(layout.name() + "_mean");
+		result[1].set_name(layout.name() + "_deviation");
+		for(int i = 0; i < result.front().volume(); ++i)
+		{
+			result[0].set_value(0, i, static_cast<float>(moments._mean[static_cast<size_t>(i)]));
+			result[1].set_value(0, i, static_cast<float>(std::sqrt(moments._m2[static_cast<size_t>(i)] / moments._count)));
+		}
+		return result;
+	}
+
+	std::vector<Field> Ensemble::streaming_gaussian_analysis(const std::vector<fs::path>& files, int field_index) const
+	{
+		if(files.empty())
+		{
+			Logger::error() << "No data for gaussian analysis.";
+			throw std::invalid_argument("Missing data for gaussian analysis");
 		}
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
 
-		for(auto& thread : threads)
-			thread.join();
+		auto result = gaussian_fields(running_moments(files, field_index), layout);
 
-		Logger::debug() << "Fields " << result[0].name() << " and "<< result[1].name() << " have been calculated successfully.";
+		Logger::debug() << "Fields " << result[0].name() << " and "<< result[1].name() << " have been calculated successfully from "
+						<< files.size() << " streamed files.";
+
+		return result;
+	}
+
+	std::vector<Field> Ensemble::sliding_gaussian_analysis(int field_index)
+	{
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+
+		auto steps = std::vector<int>{};
+		for(int c = 0; c < _cluster_size; ++c)
+			steps.push_back(_selected_step + c * _cluster_stride);
+
+		// The window is taken out while it is updated, so a failed read does not leave half updated moments behind
+		auto window = SlidingWindow{};
+		auto kept = _sliding_windows.find(field_index);
+		if(kept != _sliding_windows.end())
+		{
+			window = std::move(kept->second);
+			_sliding_windows.erase(kept);
+		}
+
+		if(window._moments._mean.size() != static_cast<size_t>(layout.volume()))
+			window = SlidingWindow{};
+
+		auto entering = std::vector<int>{};
+		auto leaving = std::vector<int>{};
+		for(auto step : steps)
+			if(window._steps.count(step) == 0)
+				entering.push_back(step);
+		for(const auto& step : window._steps)
+			if(!std::binary_search(steps.begin(), steps.end(), step.first))
+				leaving.push_back(step.first);
+
+		// Windows that share no time steps are analysed from scratch
+		if(entering.size() == steps.size())
+		{
+			window = SlidingWindow{};
+			leaving.clear();
+		}
+
+		// Only entering time steps are read. Their moments are added before those of leaving steps are removed, so samples always remain.
+		for(auto step : entering)
+		{
+			auto moments = running_moments(step_files(step, 1, 1), field_index);
+			math_util::welford_merge(window._moments, moments);
+			window._steps[step] = std::move(moments);
+		}
+		for(auto step : leaving)
+		{
+			math_util::welford_remove(window._moments, window._steps.at(step));
+			window._steps.erase(step);
+		}
+
+		// Repeated removals accumulate rounding errors, merging the moments of the time steps anew discards them
+		if(++window._updates >= sliding_window_rebuild_interval)
+		{
+			window._moments = math_util::RunningMoments{};
+			for(const auto& step : window._steps)
+				math_util::welford_merge(window._moments, step.second);
+			window._updates = 0;
+		}
+
+		Logger::debug() << "Window of field " << layout.name() << " has been moved by adding " << entering.size()
+						<< " and removing " << leaving.size() << " steps.";
 
+		auto result = gaussian_fields(window._moments, layout);
+		_sliding_windows[field_index] = std::move(window);
 		return result;
 	}
 
-	std::vector<Field> Ensemble::gaussian_mixture_analysis(const std::vector<Field>& fields)
+	const math_util::PrefixMoments* Ensemble::prefix_moments(int field_index)
+	{
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+		auto& sums = _prefix_moments[field_index];
+		auto& moments = sums._moments;
+
+		// The sums cover every file, not only those whose headers read_headers checked
+		auto mtimes = std::vector<std::int64_t>(_project_files.size());
+		std::transform(_project_files.begin(), _project_files.end(), mtimes.begin(), io_util::source_mtime);
+		if(sums._mtimes == mtimes)
+		{
+			if(sums._differing_layouts)
+				return nullptr;
+			if(moments._num_steps == static_cast<size_t>(_num_steps) && moments._members == _num_simulations
+					&& moments._shift.size() == static_cast<size_t>(layout.volume()))
+				return &moments;
+		}
+
+		// Sums that are only partially rebuilt, because reading a file failed, must not be reused
+		sums._mtimes.clear();
+		sums._differing_layouts = false;
+
+		// Files outside of the selected steps may hold fields of other layouts, which cannot be summed
+		update_header_cache(_project_files, mtimes);
+		auto differing = std::find_if(_project_files.begin(), _project_files.end(),
+									  [this] (const auto& file) { return !equal_headers(_header_cache.at(file.string())._fields, _headers); });
+		if(differing != _project_files.end())
+		{
+			Logger::warning() << "Cumulative sums of field " << layout.name() << " cannot be built, the layout of file " << *differing
+							  << " differs from the selected steps. The field is analysed without them.";
+			sums._moments = math_util::PrefixMoments{};
+			sums._differing_layouts = true;
+			sums._mtimes = std::move(mtimes);
+			return nullptr;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		// The first member of the first time step shifts all samples, so the sums of squares stay small
+		auto buffers = std::vector<Field>(worker_count(), Field(layout, false));
+		buffers.front().initialize();
+		read_member_field(_project_files.front(), field_index, buffers.front());
+		math_util::prefix_moments_reset(moments, static_cast<size_t>(_num_steps), _num_simulations, buffers.front().data());
+
+		// Each task sums the members of one time step into the steps own slot, so tasks do not share sums
+		run_tasks(static_cast<size_t>(_num_steps), [this, &buffers, &moments, field_index] (size_t s, size_t w)
+		{
+			buffers[w].initialize();
+			for(int i = 0; i < _num_simulations; ++i)
+			{
+				read_member_field(_project_files[s * static_cast<size_t>(_num_simulations) + static_cast<size_t>(i)], field_index, buffers[w]);
+				math_util::prefix_moments_add(moments, s, buffers[w].data());
+			}
+		});
+		math_util::prefix_moments_accumulate(moments);
+		sums._mtimes = std::move(mtimes);
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		Logger::debug() << "Cumulative sums of field " << layout.name() << " over " << _num_steps << " steps have been built in " << elapsed << " ms.";
+
+		return &moments;
+	}
+
+	std::vector<Field> Ensemble::prefix_gaussian_analysis(const math_util::PrefixMoments& moments, const Field& layout) const
+	{
+
+		auto result = std::vector<Field>(2, Field(1, layout.width(), layout.height(), layout.depth(), true));
+		result[0].set_name(layout.name() + "_mean");
+		result[1].set_name(layout.name() + "_deviation");
+
+		auto first_step = static_cast<size_t>(_selected_step);
+		auto count = static_cast<size_t>(_cluster_size);
+		auto stride = static_cast<size_t>(_cluster_stride);
+		_pool->parallel_for(static_cast<size_t>(result.front().volume()), gaussian_chunk_size, [&moments, &result, first_step, count, stride] (size_t begin, size_t end, size_t)
+		{
+			for(auto i = begin; i < end; ++i)
+			{
+				auto window = math_util::prefix_moments_window(moments, i, first_step, count, stride);
+				result[0].set_value(0, static_cast<int>(i), window._mean);
+				result[1].set_value(0, static_cast<int>(i), std::sqrt(window._variance));
+			}
+		});
+
+		Logger::debug() << "Fields " << result[0].name() << " and "<< result[1].name() << " have been calculated successfully from cumulative sums.";
+
+		return result;
+	}
+
+	const std::vector<Field>* Ensemble::temporal_seed(int field_index) const
+	{
+		if(!_gmm_temporal_warm_start)
+			return nullptr;
+
+		// Fields of equal volume but differing extents would seed points with the components of others
+		const auto& layout = _headers[static_cast<size_t>(field_index)];
+		auto history = _gmm_history.find(field_index);
+		if(history == _gmm_history.end()
+				|| !history->second.front().equal_layout(Field{_gmm_components, layout.width(), layout.height(), layout.depth()}))
+			return nullptr;
+		return &history->second;
+	}
+
+	std::vector<Field> Ensemble::gaussian_mixture_analysis(const SampleMatrix& samples, const Field& layout, const std::vector<Field>* seed, int first_point) const
 	{
-		constexpr int gmm_components = 4;
+		const auto gmm_components = _gmm_components;
 
-		if(fields.empty())
+		if(samples.num_samples() == 0)
 		{
 			Logger::error() << "No data for gmm analysis.";
 			throw std::invalid_argument("Missing data for gmm analysis");
 		}
-		const auto& layout = fields.front();
 		auto result = std::vector<Field>(3, Field(gmm_components, layout.width(), layout.height(), layout.depth(), true));
 		result[0].set_name(layout.name() + "_mean");
 		result[1].set_name(layout.name() + "_deviation");
 		result[2].set_name(layout.name() + "_weight");
 
-		// Set multithreading to maximum hardware concurrency
-		auto thread_count = std::min(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1), result.front().volume());
-		auto threads = std::vector<std::thread>();
-		for(int t = 0; t < thread_count; ++t)
+		auto store_gmm = [&result, gmm_components] (int i, const std::vector<math_util::GMMComponent>& gmm)
 		{
-			int start = result.front().volume() * t / thread_count;
-			int end = result.front().volume() * (t+1) / thread_count;
-			threads.emplace_back([&fields, &result, start, end] ()
+			for(int c = 0; c < gmm_components; ++c)
 			{
-				for(int i = start; i < end; ++i)
-				{
-					auto samples = std::vector<float>();
-					samples.reserve(fields.size());
-					for(const auto& field : fields)
-						samples.push_back(field.get_value(0, i));
+				//				result[0].set_value(c, i, math_util::find_max(buffer, gmm[static_cast<size_t>(c)]));
+				//				result[0].set_value(c, i, math_util::find_median(buffer, gmm[static_cast<size_t>(c)]));
+				result[0].set_value(c, i, gmm[static_cast<size_t>(c)]._mean);
+				result[1].set_value(c, i, std::sqrt(gmm[static_cast<size_t>(c)]._variance));
+				result[2].set_value(c, i, gmm[static_cast<size_t>(c)]._weight);
+			}
+		};
+
+		// Constant samples, for example of masked points, get the single gauss without variance that a fit would end up with
+		const auto num_samples = static_cast<size_t>(samples.num_samples());
+		auto is_constant = [&samples, num_samples] (int i)
+		{
+			const auto* point = samples.samples(i);
+			return std::all_of(point, point + num_samples, [point] (float s) { return s == point[0]; });
+		};
+		auto store_constant = [&result, gmm_components] (int i, float value)
+		{
+			for(int c = 0; c < gmm_components; ++c)
+			{
+				result[0].set_value(c, i, c == 0 ? value : 0.f);
+				result[1].set_value(c, i, 0.f);
+				result[2].set_value(c, i, c == 0 ? 1.f : 0.f);
+			}
+		};
 
-					std::sort(samples.begin(), samples.end());
-					auto gmm = math_util::fit_gmm(samples, gmm_components);
+		// Fits from scratch are memoised by the hash of the raw samples of their point. Every thread remembers the points it
+		// fitted itself, so a hit copies a result that is complete. Hash collisions are resolved by comparing the samples.
+		using GMMMemo = std::unordered_multimap<size_t, int>;
+		const auto memoise = _gmm_memoization && !seed && !_gmm_warm_start;
+		auto memos = std::vector<GMMMemo>(memoise ? _pool->thread_count() : 0);
+		auto hash_samples = [&samples, num_samples] (int i)
+		{
+			return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(samples.samples(i)), num_samples * sizeof(float)));
+		};
+		auto recall = [&samples, &result, &memos, num_samples, gmm_components] (size_t worker, int i, size_t hash)
+		{
+			auto range = memos[worker].equal_range(hash);
+			for(auto it = range.first; it != range.second; ++it)
+			{
+				if(std::memcmp(samples.samples(it->second), samples.samples(i), num_samples * sizeof(float)) != 0)
+					continue;
+				for(auto& field : result)
 					for(int c = 0; c < gmm_components; ++c)
+						field.set_value(c, i, field.get_value(c, it->second));
+				return true;
+			}
+			return false;
+		};
+		auto remember = [&memos] (size_t worker, int i, size_t hash)
+		{
+			auto& memo = memos[worker];
+			if(memo.size() >= gmm_memo_capacity)
+				memo.clear();
+			memo.emplace(hash, i);
+		};
+		auto constant_points = std::vector<long>(_pool->thread_count(), 0);
+		auto memoised_points = std::vector<long>(_pool->thread_count(), 0);
+
+		// GMM fits differ widely in cost, small chunks let idle threads steal the expensive ones
+		// Scratch buffers are owned per thread, so the fits do not allocate once the buffers have grown
+		auto point_samples = std::vector<std::vector<float>>(_pool->thread_count());
+		auto start = std::chrono::steady_clock::now();
+		if(!_batched_gmm || _gmm_warm_start || seed || _gmm_histogram_bins != 0 || _gmm_accelerated_em || _gmm_split_search || _gmm_random_init)
+		{
+			// EM iterations of points fitted from scratch and of points seeded by a neighbour
+			struct FitStatistics
+			{
+				long _cold_points{0};
+				long _cold_iterations{0};
+				long _warm_points{0};
+				long _warm_iterations{0};
+			};
+
+			auto workspaces = std::vector<math_util::GMMWorkspace>(_pool->thread_count());
+			for(auto& workspace : workspaces)
+			{
+				workspace._accelerated_em = _gmm_accelerated_em;
+				workspace._split_search = _gmm_split_search;
+				workspace._random_init = _gmm_random_init;
+			}
+			auto gmms = std::vector<std::vector<math_util::GMMComponent>>(_pool->thread_count());
+			auto previous_gmms = std::vector<std::vector<math_util::GMMComponent>>(_pool->thread_count());
+			auto seed_gmms = std::vector<std::vector<math_util::GMMComponent>>(_pool->thread_count());
+			auto statistics = std::vector<FitStatistics>(_pool->thread_count());
+			auto chunk_size = _gmm_warm_start ? gmm_warm_start_chunk_size : gmm_chunk_size;
+			const auto bins = static_cast<unsigned>(_gmm_histogram_bins);
+			auto fit = [bins, gmm_components] (const std::vector<float>& buffer, const std::vector<math_util::GMMComponent>& seed_gmm,
+											   math_util::GMMWorkspace& workspace, std::vector<math_util::GMMComponent>& gmm)
+			{
+				if(bins != 0)
+					math_util::fit_gmm_binned(buffer, gmm_components, bins, seed_gmm, workspace, gmm);
+				else
+					math_util::fit_gmm(buffer, gmm_components, seed_gmm, workspace, gmm);
+			};
+			_pool->parallel_for(static_cast<size_t>(result.front().volume()), chunk_size, [&] (size_t begin, size_t end, size_t worker)
+			{
+				auto& buffer = point_samples[worker];
+				auto& workspace = workspaces[worker];
+				buffer.resize(num_samples);
+				for(auto i = static_cast<int>(begin); i < static_cast<int>(end); ++i)
+				{
+					// The constant GMM is also the warm start of the next point, like a fitted one would be
+					if(is_constant(i))
+					{
+						math_util::constant_gmm(samples.samples(i)[0], gmm_components, gmms[worker]);
+						store_gmm(i, gmms[worker]);
+						std::swap(gmms[worker], previous_gmms[worker]);
+						++constant_points[worker];
+						continue;
+					}
+					size_t hash = 0;
+					if(memoise)
+					{
+						hash = hash_samples(i);
+						if(recall(worker, i, hash))
+						{
+							++memoised_points[worker];
+							continue;
+						}
+					}
+
+					std::copy_n(samples.samples(i), buffer.size(), buffer.begin());
+					std::sort(buffer.begin(), buffer.end());
+					workspace._random.seed(math_util::random_seed(static_cast<std::uint64_t>(first_point + i)));
+
+					// Seed with the components of the point in the previous analysis of the field. Otherwise chunks are
+					// traversed along rows, each point is seeded by its left neighbour inside of the chunk.
+					auto warm = seed || (_gmm_warm_start && i != static_cast<int>(begin) && i % layout.width() != 0);
+					auto iterations = workspace._em_iterations;
+					if(seed)
 					{
-						//				result[0].set_value(c, i, math_util::find_max(samples, gmm[static_cast<size_t>(c)]));
-						//				result[0].set_value(c, i, math_util::find_median(samples, gmm[static_cast<size_t>(c)]));
-						result[0].set_value(c, i, gmm[static_cast<size_t>(c)]._mean);
-						result[1].set_value(c, i, std::sqrt(gmm[static_cast<size_t>(c)]._variance));
-						result[2].set_value(c, i, gmm[static_cast<size_t>(c)]._weight);
+						auto& seed_gmm = seed_gmms[worker];
+						seed_gmm.resize(gmm_components);
+						for(int c = 0; c < gmm_components; ++c)
+							seed_gmm[static_cast<size_t>(c)] = {(*seed)[0].get_value(c, first_point + i),
+																math_util::square((*seed)[1].get_value(c, first_point + i)),
+																(*seed)[2].get_value(c, first_point + i)};
+						fit(buffer, seed_gmm, workspace, gmms[worker]);
 					}
+					else if(warm)
+						fit(buffer, previous_gmms[worker], workspace, gmms[worker]);
+					else
+						fit(buffer, {}, workspace, gmms[worker]);
+					iterations = workspace._em_iterations - iterations;
+
+					// The fits ignore seeds with fewer than two weighted components, so such points count as fitted from scratch
+					const auto& used_seed = seed ? seed_gmms[worker] : previous_gmms[worker];
+					auto seeded = warm && std::count_if(used_seed.begin(), used_seed.end(), [] (const auto& c) { return c._weight != 0.f; }) >= 2;
+					auto& stats = statistics[worker];
+					(seeded ? stats._warm_points : stats._cold_points) += 1;
+					(seeded ? stats._warm_iterations : stats._cold_iterations) += iterations;
+
+					store_gmm(i, gmms[worker]);
+					std::swap(gmms[worker], previous_gmms[worker]);
+					if(memoise)
+						remember(worker, i, hash);
 				}
 			});
+
+			long density_evaluations = 0;
+			auto total = FitStatistics{};
+			for(size_t t = 0; t < workspaces.size(); ++t)
+			{
+				density_evaluations += workspaces[t]._density_evaluations;
+				total._cold_points += statistics[t]._cold_points;
+				total._cold_iterations += statistics[t]._cold_iterations;
+				total._warm_points += statistics[t]._warm_points;
+				total._warm_iterations += statistics[t]._warm_iterations;
+			}
+			Logger::debug() << "GMM fits evaluated " << density_evaluations << " component densities.";
+
+			if(total._cold_points != 0 && total._warm_points != 0)
+			{
+				auto cold_average = static_cast<double>(total._cold_iterations) / total._cold_points;
+				auto warm_average = static_cast<double>(total._warm_iterations) / total._warm_points;
+				Logger::debug() << "GMM warm start saved " << cold_average - warm_average << " EM iterations per point ("
+								<< warm_average << " for " << total._warm_points << " seeded points, "
+								<< cold_average << " for " << total._cold_points << " points fitted from scratch).";
+			}
+			else if(total._warm_points != 0)
+				Logger::debug() << "GMM fits seeded by the previous analysis needed "
+								<< static_cast<double>(total._warm_iterations) / total._warm_points << " EM iterations per point.";
+			else if(total._cold_points != 0)
+				Logger::debug() << "GMM fits needed " << static_cast<double>(total._cold_iterations) / total._cold_points << " EM iterations per point.";
 		}
+		else
+		{
+			// Fit gmm_batch_size points at once, their sorted samples are interleaved into one buffer
+			auto batch_samples = std::vector<std::vector<float>>(_pool->thread_count());
+			auto workspaces = std::vector<math_util::GMMBatchWorkspace>(_pool->thread_count());
+			auto batch_gmms = std::vector<std::vector<std::vector<math_util::GMMComponent>>>(_pool->thread_count());
+			// Points of the current batch and the hashes of their samples
+			auto batch_points = std::vector<std::vector<std::pair<int, size_t>>>(_pool->thread_count());
+			_pool->parallel_for(static_cast<size_t>(result.front().volume()), gmm_chunk_size, [&] (size_t begin, size_t end, size_t worker)
+			{
+				auto& buffer = point_samples[worker];
+				auto& batch = batch_samples[worker];
+				auto& gmms = batch_gmms[worker];
+				auto& points = batch_points[worker];
+				buffer.resize(num_samples);
+				batch.resize(buffer.size() * math_util::gmm_batch_size);
+				points.clear();
+
+				auto fit_batch = [&] ()
+				{
+					for(size_t l = 0; l < math_util::gmm_batch_size; ++l)
+					{
+						// Unused lanes repeat the last point
+						if(l < points.size())
+						{
+							std::copy_n(samples.samples(points[l].first), buffer.size(), buffer.begin());
+							std::sort(buffer.begin(), buffer.end());
+						}
+						for(size_t s = 0; s < buffer.size(); ++s)
+							batch[s * math_util::gmm_batch_size + l] = buffer[s];
+					}
+
+					math_util::fit_gmm_batch(batch, gmm_components, points.size(), workspaces[worker], gmms);
+					for(size_t l = 0; l < points.size(); ++l)
+					{
+						store_gmm(points[l].first, gmms[l]);
+						if(memoise)
+							remember(worker, points[l].first, points[l].second);
+					}
+					points.clear();
+				};
+
+				// Constant and memoised points are stored right away, the others are collected into full batches
+				for(auto i = static_cast<int>(begin); i < static_cast<int>(end); ++i)
+				{
+					if(is_constant(i))
+					{
+						store_constant(i, samples.samples(i)[0]);
+						++constant_points[worker];
+						continue;
+					}
+					size_t hash = 0;
+					if(memoise)
+					{
+						hash = hash_samples(i);
+						if(recall(worker, i, hash))
+						{
+							++memoised_points[worker];
+							continue;
+						}
+					}
+					points.emplace_back(i, hash);
+					if(points.size() == math_util::gmm_batch_size)
+						fit_batch();
+				}
+				if(!points.empty())
+					fit_batch();
+			});
 
-		for(auto& thread : threads)
-			thread.join();
+			long density_evaluations = 0;
+			for(const auto& workspace : workspaces)
+				density_evaluations += workspace._density_evaluations;
+			Logger::debug() << "Batched GMM fits evaluated " << density_evaluations << " component densities.";
+		}
 
+		auto skipped_constant = std::accumulate(constant_points.begin(), constant_points.end(), 0l);
+		auto skipped_memoised = std::accumulate(memoised_points.begin(), memoised_points.end(), 0l);
+		if(skipped_constant != 0 || skipped_memoised != 0)
+			Logger::debug() << "GMM analysis skipped the fits of " << skipped_constant << " points with constant samples and "
+							<< skipped_memoised << " points with memoised samples.";
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		Logger::debug() << "GMM fits of " << result.front().volume() << " points took " << elapsed.count() << " ms.";
 		Logger::debug() << "Fields " << result[0].name()
 						<< ", "<< result[1].name()
 						<< " and "<< result[2].name()
@@ -302,27 +998,70 @@ namespace vis
 		return result;
 	}
 
-	int Ensemble::count_files(const fs::path& dir)
+	io_util::EnsembleManifest Ensemble::scan_directory(const fs::path& root)
 	{
-		if(!fs::is_directory(dir))
+		if(!fs::is_directory(root))
 		{
-			Logger::error() << "Counting files failed. "
-							<< dir.string() << " does not point to a directory.";
+			Logger::error() << "Scanning ensemble failed. "
+							<< root.string() << " does not point to a directory.";
 			throw std::invalid_argument("Path does not point to directory");
 		}
-		return static_cast<int>(std::count_if(fs::directory_iterator(dir), fs::directory_iterator{},
-											  [] (const auto& path) { return fs::is_regular_file(path); }));
-	}
 
-	int Ensemble::count_directories(const fs::path& dir)
-	{
-		if(!fs::is_directory(dir))
+		auto manifest = io_util::EnsembleManifest{};
+		manifest._directories.emplace_back(root, io_util::source_mtime(root));
+
+		// Single pass over root, collecting files and subdirectories
+		auto root_files = std::vector<fs::path>{};
+		auto directories = std::vector<fs::path>{};
+		for(const auto& entry : fs::directory_iterator{root})
 		{
-			Logger::error() << "Counting directories failed. "
-							<< dir.string() << " does not point to a directory.";
-			throw std::invalid_argument("Path does not point to directory");
+			if(fs::is_directory(entry.status()))
+				directories.push_back(entry.path());
+			else if(fs::is_regular_file(entry.status()))
+				root_files.push_back(entry.path());
 		}
-		return static_cast<int>(std::count_if(fs::directory_iterator(dir), fs::directory_iterator{},
-											  [] (const auto& path) { return fs::is_directory(path); }));
+
+		// Load ensemble with a single timestep
+		if(directories.empty())
+		{
+			manifest._num_simulations = static_cast<int>(root_files.size());
+			manifest._num_steps = 1;
+			manifest._files = std::move(root_files);
+			return manifest;
+		}
+
+		// Load Ensemble with multiple time steps
+		manifest._num_simulations = static_cast<int>(directories.size());
+		manifest._num_steps = -1;
+		for(const auto& directory : directories)
+		{
+			manifest._directories.emplace_back(directory, io_util::source_mtime(directory));
+
+			int num_files = 0;
+			for(const auto& entry : fs::directory_iterator{directory})
+			{
+				if(fs::is_regular_file(entry.status()))
+				{
+					manifest._files.push_back(entry.path());
+					++num_files;
+				}
+			}
+
+			// Search for a subdirectory of root with amount of files not equal to the others
+			if(manifest._num_steps != -1 && manifest._num_steps != num_files)
+			{
+				Logger::error() << "Ensemble root directory does not contain subdirectories of the same size. "
+								<< "Path: " << root;
+
+				throw std::invalid_argument("Path does not follow the expected ensemble directory structure");
+			}
+			manifest._num_steps = num_files;
+		}
+
+		// Sort by path (simulation), then stably by name (timestep)
+		std::sort(manifest._files.begin(), manifest._files.end());
+		std::stable_sort(manifest._files.begin(), manifest._files.end(),
+						 [] (const fs::path& a, const fs::path& b) { return a.filename() < b.filename(); });
+		return manifest;
 	}
 }
@@ -3,9 +3,17 @@
 
 #include <experimental/filesystem>
 #include <vector>
-#include <istream>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <memory>
 
 #include "field.h"
+#include "io_util.h"
+#include "math_util.h"
+#include "sample_matrix.h"
+#include "thread_pool.h"
 
 namespace vis
 {
@@ -17,6 +25,23 @@ namespace vis
 	class Ensemble
 	{
 	public:
+		/// Number of points analysed by one gaussian analysis task.
+		static constexpr size_t gaussian_chunk_size = 1024;
+		/// Number of member files read_samples reads into staging buffers before transposing them into the sample matrix at once.
+		static constexpr size_t read_group_size = 16;
+		/// Number of member files streaming analyses read at once, while they fold the files read before into the running moments.
+		static constexpr size_t streaming_read_buffers = 16;
+		/// Number of components the GMM renderers need at least.
+		static constexpr int gmm_min_components = 4;
+		/// Number of points fitted by one gmm analysis task.
+		static constexpr size_t gmm_chunk_size = 16;
+		/// Number of points fitted by one gmm analysis task with warm start. Only the first point of a task is fitted from scratch.
+		static constexpr size_t gmm_warm_start_chunk_size = 64;
+		/// Number of fits each thread memoises, before it forgets all of them.
+		static constexpr size_t gmm_memo_capacity = 1 << 16;
+		/// Number of updates of a sliding window, after which its moments are merged from the moments of its time steps anew.
+		static constexpr size_t sliding_window_rebuild_interval = 64;
+
 		enum class Analysis
 		{
 			GAUSSIAN_SINGLE = 0,
@@ -25,8 +50,154 @@ namespace vis
 
 		/**
 		 * @brief Ensemble Creates an ensemble from files stored at the root directory.
+		 * @param root The ensemble root directory.
+		 * @param cache_directory The directory binary caches of the ensemble files and the ensemble manifest are stored in.
+		 * The manifest records the directory layout, so later constructions do not have to scan the directory tree.
+		 * If empty, the directory tree is scanned and the text files are parsed every time a field is analysed.
+		 */
+		explicit Ensemble(const fs::path& root, const fs::path& cache_directory = default_cache_directory());
+
+		/**
+		 * @brief default_cache_directory Returns the directory that is used for caches, if none is specified.
 		 */
-		explicit Ensemble(const fs::path& root);
+		static fs::path default_cache_directory();
+
+		/**
+		 * @brief set_binary_cache Selects whether member fields are read from binary caches.
+		 * If disabled, the text files are parsed directly, seeking to the fields through persisted offset indices.
+		 * Both binary caches and offset indices are stored in the cache directory.
+		 */
+		void set_binary_cache(bool enabled);
+
+		/**
+		 * @brief set_streaming Selects whether GAUSSIAN_SINGLE analyses fold each file into running statistics while reading.
+		 * Streaming keeps memory usage independent of the number of analysed files and threads: 16 bytes per point for the moments
+		 * and two sets of streaming_read_buffers read fields. One set is read while the other one is folded into the moments.
+		 * If disabled, all files are read into memory before they are analysed.
+		 */
+		void set_streaming(bool enabled);
+
+		/**
+		 * @brief set_temporal_prefix_sums Selects whether GAUSSIAN_SINGLE analyses derive means and deviations from cumulative sums
+		 * over all time steps of a field, which are built the first time the field is analysed.
+		 * Afterwards any window of time steps is analysed without reading files: a contiguous window costs two subtractions per point,
+		 * a strided window one per aggregated time step. The sums take 16 bytes per point and time step. Every analysis compares the
+		 * modification times of all files with those the sums were built from and rebuilds them, if any file was modified.
+		 * If any file holds fields of other layouts than the selected steps, no sums are built and fields are analysed without them.
+		 * Takes precedence over streaming. Disabling drops the sums. Disabled by default.
+		 */
+		void set_temporal_prefix_sums(bool enabled);
+
+		/**
+		 * @brief set_sliding_window Selects whether GAUSSIAN_SINGLE analyses keep the running moments of the last window of time steps
+		 * of each field and update them for the next window: the members of time steps that enter the window are added, those of
+		 * time steps that leave it are removed. Stepping a window of any aggregation count by its stride then reads the files of
+		 * one time step instead of all of them. The moments of each time step of the window are kept, so removing a time step reads
+		 * no files, and every sliding_window_rebuild_interval updates the moments of the window are merged from them anew,
+		 * which bounds the rounding errors of repeated removals. Windows that share no time steps are analysed from scratch.
+		 * The moments take 24 bytes per point and aggregated time step. Temporal prefix sums take precedence.
+		 * Disabling drops the moments. Disabled by default.
+		 */
+		void set_sliding_window(bool enabled);
+
+		/**
+		 * @brief set_memory_budget Limits the memory used for the fields read during an analysis.
+		 * If all files of the selected time steps do not fit into the budget at once, the volume is split
+		 * into slabs of rows that are read and analysed one after another. The budget includes the staging buffers of the reading threads.
+		 * @param bytes The memory budget in bytes. 0 disables the limit.
+		 */
+		void set_memory_budget(size_t bytes);
+
+		/**
+		 * @brief set_result_cache_limit Selects whether the results of analyses are stored in the cache directory and
+		 * loaded again by later analyses, also of later ensembles, with the same time steps, field, analysis and settings.
+		 * The results are keyed by the modification times of the analysed files, so modifying a file causes a new analysis.
+		 * Results of temporally seeded GAUSSIAN_MIXTURE analyses are neither stored nor loaded.
+		 * @param bytes The maximum size of all stored results. The least recently used results are removed once it is exceeded.
+		 * 0 disables the result cache, which is the default.
+		 */
+		void set_result_cache_limit(std::uintmax_t bytes);
+
+		/**
+		 * @brief set_batched_gmm Selects whether GAUSSIAN_MIXTURE analyses fit several points at once in SIMD lanes.
+		 * The batched fit approximates exp and log, so its results may differ from the scalar fit within float precision,
+		 * and points at borderline AIC comparisons may get another number of components. It only pays off, if the compiler
+		 * targets AVX2 or AVX-512 (qmake CONFIG+=native), see simd_util::vectorized. Disabled by default.
+		 */
+		void set_batched_gmm(bool enabled);
+
+		/**
+		 * @brief set_gmm_warm_start Selects whether GAUSSIAN_MIXTURE analyses seed the fit of a point with the GMM of its left neighbour.
+		 * Neighbouring points have similar samples, so the seeded EM converges in fewer iterations and the search over the number
+		 * of components can skip the smaller models. Results may differ from fits from scratch, where EM converges to another optimum.
+		 * The points are fitted one by one, so batching is disabled while warm start is enabled. Disabled by default.
+		 */
+		void set_gmm_warm_start(bool enabled);
+
+		/**
+		 * @brief set_gmm_components Sets the maximum number of components of the GMMs fitted by GAUSSIAN_MIXTURE analyses.
+		 * Counts up to 8 use fit kernels specialized at compile time. Fewer components than gmm_min_components cannot be shown
+		 * by the GMM renderers, which draw only the first gmm_min_components components of larger GMMs. Warns about this, if
+		 * count is larger. Throws, if count is smaller than gmm_min_components, which is also the default.
+		 */
+		void set_gmm_components(int count);
+
+		/**
+		 * @brief set_gmm_histogram_bins Selects whether GAUSSIAN_MIXTURE analyses run EM on a histogram of each points samples.
+		 * An EM iteration then costs the same for any number of samples, which pays off for ensembles with many members or
+		 * aggregated time steps. Means and deviations are only accurate up to a fraction of the range of the samples divided by bins.
+		 * Points with no more samples than bins are fitted exactly. Binned fits run one point at a time, so batching is disabled.
+		 * @param bins The number of bins, for example math_util::fit_gmm_default_bins. 0 disables binning, which is the default.
+		 * Throws, if bins is negative.
+		 */
+		void set_gmm_histogram_bins(int bins);
+
+		/**
+		 * @brief set_gmm_accelerated_em Selects whether GAUSSIAN_MIXTURE analyses refine GMMs by accelerated EM (SQUAREM) instead of plain EM.
+		 * Accelerated EM extrapolates the parameter updates and never decreases the likelihood. It needs far fewer EM steps
+		 * on poorly separated modes, but may converge to other optima than plain EM. Accelerated fits run one point at a time,
+		 * so batching is disabled. Disabled by default.
+		 */
+		void set_gmm_accelerated_em(bool enabled);
+
+		/**
+		 * @brief set_gmm_split_search Selects whether GAUSSIAN_MIXTURE analyses start each number of components from the best GMM with
+		 * one component less, whose widest component is split, instead of a fresh initialization. The search also stops once
+		 * another component improves the AIC only marginally. Split fits run one point at a time, so batching is disabled.
+		 * Disabled by default.
+		 */
+		void set_gmm_split_search(bool enabled);
+
+		/**
+		 * @brief set_gmm_memoization Selects whether GAUSSIAN_MIXTURE analyses reuse the GMM of a point whose samples are identical
+		 * to those of an already fitted point, found by hashing the samples. Only fits from scratch are memoised, so it has no effect
+		 * with warm starts. Points with constant samples, like masked ones, never run a fit, independent of this setting.
+		 * Disabled by default.
+		 */
+		void set_gmm_memoization(bool enabled);
+
+		/**
+		 * @brief set_gmm_random_init Selects whether GAUSSIAN_MIXTURE analyses initialize each number of components at the best of
+		 * math_util::fit_gmm_random_init_tries random picks of samples, instead of evenly spaced samples.
+		 * The random engine is reseeded for every point from its scrambled index, so results do not depend on the number of threads or tiles.
+		 * Random fits run one point at a time, so batching is disabled. Disabled by default.
+		 */
+		void set_gmm_random_init(bool enabled);
+
+		/**
+		 * @brief set_gmm_temporal_warm_start Selects whether GAUSSIAN_MIXTURE analyses keep their components and seed the next
+		 * analysis of the same field with them, for example after stepping to the next time step.
+		 * Consecutive time steps differ little, so most fits converge after few EM iterations.
+		 * Like the spatial warm start, results may differ from fits from scratch and batching is disabled for seeded analyses.
+		 * Disabling drops the kept components. Disabled by default.
+		 */
+		void set_gmm_temporal_warm_start(bool enabled);
+
+		/**
+		 * @brief set_thread_count Replaces the thread pool that reads files and analyses fields.
+		 * @param thread_count The number of threads. If 0, the hardware concurrency is used.
+		 */
+		void set_thread_count(size_t thread_count);
 
 		/**
 		 * @brief num_steps Returns the number of time steps that are available.
@@ -66,15 +237,145 @@ namespace vis
 		void analyse_field(int field_index, Analysis analysis);
 
 	private:
-		static void ignore_many(std::istream& stream, int count, char delimiter);
+		/**
+		 * @brief The TemporalSums struct holds the cumulative sums of a field and the modification times of the files they were built from.
+		 */
+		struct TemporalSums
+		{
+			std::vector<std::int64_t> _mtimes{};	///< Modification time of every file of the ensemble, in the order of _project_files.
+			math_util::PrefixMoments _moments{};
+			bool _differing_layouts{false};			///< True, if the files hold fields of differing layouts, so no sums were built.
+		};
+
+		/**
+		 * @brief The SlidingWindow struct holds the running moments of a field over the aggregated time steps of a window.
+		 */
+		struct SlidingWindow
+		{
+			std::map<int, math_util::RunningMoments> _steps{};	///< Running moments of each aggregated time step.
+			math_util::RunningMoments _moments{};				///< Running moments of all aggregated time steps.
+			size_t _updates{0};									///< Number of updates since _moments was merged from _steps.
+		};
 
-		static std::vector<Field> gaussian_analysis(const std::vector<Field>& fields);
-		static std::vector<Field> gaussian_mixture_analysis(const std::vector<Field>& fields);
+		/**
+		 * @brief The CachedHeader struct holds the parsed layout data of an ensemble member file.
+		 */
+		struct CachedHeader
+		{
+			std::int64_t _mtime;	///< Modification time of the file when it was parsed.
+			std::vector<Field> _fields;
+		};
 
-		/// @brief Returns number (>=0) of files in dir. Throws exception if dir is not a directory.
-		static int count_files(const fs::path& dir);
-		/// @brief Returns number (>=0) of directories in dir. Throws exception if dir is not a directory.
-		static int count_directories(const fs::path& dir);
+		/**
+		 * @brief update_header_cache Parses the headers of files that are not cached or whose modification time differs from mtimes.
+		 * Drops sliding windows, if a cached file has been modified.
+		 */
+		void update_header_cache(const std::vector<fs::path>& files, const std::vector<std::int64_t>& mtimes);
+		/**
+		 * @brief equal_headers Returns true, if both vectors hold fields of equal layouts and names at the same indices.
+		 */
+		static bool equal_headers(const std::vector<Field>& a, const std::vector<Field>& b);
+
+		/**
+		 * @brief step_files Returns the files of count time steps starting at step_index, stride time steps apart.
+		 * The files are ordered by aggregated time step, then by simulation.
+		 */
+		std::vector<fs::path> step_files(int step_index, int count, int stride) const;
+
+		/**
+		 * @brief run_analysis Analyses a field over files with the method selected by the settings.
+		 */
+		std::vector<Field> run_analysis(const std::vector<fs::path>& files, int field_index, Analysis analysis);
+		/**
+		 * @brief result_key Describes an analysis and all of its inputs for the result cache.
+		 */
+		std::string result_key(const std::vector<fs::path>& files, int field_index, Analysis analysis) const;
+
+		/**
+		 * @brief worker_count Returns the number of threads run_tasks uses.
+		 */
+		size_t worker_count() const;
+		/**
+		 * @brief run_tasks Calls task(i, w) for each i in [0, count) on the thread pool.
+		 * w in [0, worker_count()) identifies the calling thread, so tasks can use per-thread state.
+		 * Rethrows the first exception thrown by a task after all tasks finished.
+		 */
+		void run_tasks(size_t count, const std::function<void(size_t, size_t)>& task) const;
+
+		/**
+		 * @brief read_member_field Reads one field (or consecutive rows of it) of an ensemble member file into field.
+		 * Reads from the members binary cache, if possible.
+		 * Otherwise the text file is parsed and the cache is (re)built from it.
+		 * If binary caches are disabled, the field is parsed at the location stored in the members offset index.
+		 * Safe to be called concurrently for different files.
+		 * @param first_row The first row that is read. Rows are numbered across layers (y + z*height).
+		 * field receives field.height()*field.depth() rows.
+		 */
+		void read_member_field(const fs::path& file, int field_index, Field& field, int first_row = 0) const;
+
+		/**
+		 * @brief sample_memory Returns the peak number of bytes read_samples uses to read num_points points from num_files files,
+		 * which includes the sample matrix and the staging buffers of all workers.
+		 */
+		size_t sample_memory(size_t num_files, size_t num_points) const;
+
+		/**
+		 * @brief read_samples Reads consecutive rows of a field from files into a point-major sample matrix.
+		 * Sample j of each point is read from files[j].
+		 */
+		SampleMatrix read_samples(const std::vector<fs::path>& files, int field_index, int first_row, int num_rows) const;
+
+		std::vector<Field> gaussian_analysis(const SampleMatrix& samples, const Field& layout) const;
+		/**
+		 * @brief tiled_analysis Analyses a field over files in slabs of rows that fit into the memory budget.
+		 */
+		std::vector<Field> tiled_analysis(const std::vector<fs::path>& files, int field_index, Analysis analysis) const;
+		/**
+		 * @brief running_moments Folds a field of every file into running moments. Reads groups of streaming_read_buffers files,
+		 * while the workers fold the previous group into disjoint ranges of points.
+		 */
+		math_util::RunningMoments running_moments(const std::vector<fs::path>& files, int field_index) const;
+		/**
+		 * @brief gaussian_fields Returns the mean and standard deviation fields of running moments.
+		 */
+		static std::vector<Field> gaussian_fields(const math_util::RunningMoments& moments, const Field& layout);
+		/**
+		 * @brief streaming_gaussian_analysis Calculates means and standard deviations of a field over files.
+		 * The files are folded into running moments by running_moments, so they are never all held in memory.
+		 */
+		std::vector<Field> streaming_gaussian_analysis(const std::vector<fs::path>& files, int field_index) const;
+		/**
+		 * @brief sliding_gaussian_analysis Calculates means and standard deviations of a field over the selected time steps by
+		 * updating the running moments of the last analysed window.
+		 */
+		std::vector<Field> sliding_gaussian_analysis(int field_index);
+		/**
+		 * @brief prefix_moments Returns the cumulative sums of a field over all time steps. Reads every file of the ensemble
+		 * once to build them, if they are missing, a file was modified or the layout of the field changed.
+		 * Returns nullptr, if the headers of any file differ from those of the selected steps.
+		 */
+		const math_util::PrefixMoments* prefix_moments(int field_index);
+		/**
+		 * @brief prefix_gaussian_analysis Calculates means and standard deviations of a field over the selected time steps from its cumulative sums.
+		 */
+		std::vector<Field> prefix_gaussian_analysis(const math_util::PrefixMoments& moments, const Field& layout) const;
+		/**
+		 * @brief temporal_seed Returns the components of the last GAUSSIAN_MIXTURE analysis of a field,
+		 * if temporal warm start is enabled and the layout of the field did not change. Otherwise nullptr.
+		 */
+		const std::vector<Field>* temporal_seed(int field_index) const;
+		/**
+		 * @brief gaussian_mixture_analysis Fits GMMs to the samples of every point.
+		 * @param seed The mean, deviation and weight fields of a previous analysis of the whole field. Each point is seeded with its components.
+		 * @param first_point The index of the first point of samples inside of the seed fields.
+		 */
+		std::vector<Field> gaussian_mixture_analysis(const SampleMatrix& samples, const Field& layout, const std::vector<Field>* seed = nullptr, int first_point = 0) const;
+
+		/**
+		 * @brief scan_directory Determines the layout of the ensemble stored at root by walking its directory tree once.
+		 * Throws, if root is not a directory or its subdirectories contain differing numbers of files.
+		 */
+		static io_util::EnsembleManifest scan_directory(const fs::path& root);
 
 		int _num_simulations;
 		int _num_steps;
@@ -85,8 +386,34 @@ namespace vis
 
 		std::vector<Field> _headers{};
 		std::vector<Field> _fields{};
+		/// Layout data of every file read so far, keyed by path.
+		std::unordered_map<std::string, CachedHeader> _header_cache{};
 
 		std::vector<fs::path> _project_files{};
+		fs::path _cache_directory{};
+		bool _binary_cache{true};
+		bool _streaming{true};
+		size_t _memory_budget{0};
+		std::uintmax_t _result_cache_limit{0};
+		bool _batched_gmm{false};
+		int _gmm_components{gmm_min_components};
+		int _gmm_histogram_bins{0};
+		bool _gmm_accelerated_em{false};
+		bool _gmm_split_search{false};
+		bool _gmm_memoization{false};
+		bool _gmm_random_init{false};
+		bool _gmm_warm_start{false};
+		bool _gmm_temporal_warm_start{false};
+		bool _temporal_prefix_sums{false};
+		/// Cumulative sums of each field over all time steps, if temporal prefix sums are enabled.
+		std::unordered_map<int, TemporalSums> _prefix_moments{};
+		bool _sliding_window{false};
+		/// Running moments of the last window of each field, if sliding windows are enabled.
+		std::unordered_map<int, SlidingWindow> _sliding_windows{};
+		/// Results of the last GAUSSIAN_MIXTURE analysis of each field, if temporal warm start is enabled.
+		std::unordered_map<int, std::vector<Field>> _gmm_history{};
+
+		std::unique_ptr<ThreadPool> _pool;
 	};
 }
 #endif // ENSEMBLE_H
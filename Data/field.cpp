@@ -220,6 +220,17 @@ namespace vis
 		return _data;
 	}
 
+	std::vector<float>& Field::data()
+	{
+		if(!_initialized)
+		{
+			Logger::error() << "Data access on uninitialized field.";
+			throw std::runtime_error("Field data accessed before initializing");	// ERROR handling. Field not initialized.
+		}
+
+		return _data;
+	}
+
 	std::vector<float> Field::get_point(int i) const
 	{
 		if(!_initialized)
@@ -93,6 +93,9 @@ namespace vis
 		std::string layout_to_string() const;
 
 		const std::vector<float>& data() const;
+		/// @brief data Returns the fields data for direct writing. Only possible if initialized().
+		/// The size of the returned collection must not be changed.
+		std::vector<float>& data();
 		/// @brief get_point Gets all components of the i-th point of the field. Only possible if initialized().
 		/// @return A vector containing point_dimension() floats.
 		std::vector<float> get_point(int i) const;
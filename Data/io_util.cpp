@@ -0,0 +1,573 @@
+#include "io_util.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+#include "logger.h"
+#include "mapped_file.h"
+
+namespace vis
+{
+	fs::path io_util::cache_path(const fs::path& cache_root, const fs::path& source, const std::string& extension)
+	{
+		auto path = cache_root / fs::absolute(source).relative_path();
+		path += extension;
+		return path;
+	}
+
+	std::int64_t io_util::source_mtime(const fs::path& source)
+	{
+		return static_cast<std::int64_t>(fs::last_write_time(source).time_since_epoch().count());
+	}
+
+	std::vector<Field> io_util::read_member_header(const fs::path& source)
+	{
+		auto ifs = std::ifstream{source};
+		auto buff = std::string{};
+
+		// Read layout
+		std::getline(ifs, buff);
+		auto line = std::istringstream{buff};
+		std::getline(line, buff, ' ');
+		auto width = std::stoi(buff);
+		std::getline(line, buff, ' ');
+		auto height = std::stoi(buff);
+		std::getline(line, buff, ' ');
+		auto depth = std::stoi(buff);
+
+		// Check if total points = volume
+		std::getline(line, buff, ' ');
+		auto total = std::stoi(buff);
+		if(total != width*height*depth)
+		{
+			Logger::error() << "Field in file " << source
+							<< " has invalid dimensions: "
+							<< "width: " << width << " height: " << height << " depth: " << depth << " total:" << total;
+
+			throw std::runtime_error("Total size in simulation header is invalid");
+		}
+
+		// Read number of fields
+		std::getline(ifs, buff);
+		line = std::istringstream{buff};
+		std::getline(line, buff, ' ');
+		auto fields = std::vector<Field>(std::stoul(buff), Field(1, width, height, depth));
+
+		// Read field names
+		for(auto& field : fields)
+		{
+			std::getline(line, buff, ' ');
+			field.set_name(buff);
+		}
+		return fields;
+	}
+
+	const char* io_util::skip_lines(const char* begin, const char* end, int count)
+	{
+		for(int i = 0; i < count && begin != end; ++i)
+		{
+			auto newline = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+			begin = newline ? newline + 1 : end;
+		}
+		return begin;
+	}
+
+	void io_util::parse_values(const char* begin, const char* end, const fs::path& source, Field& field)
+	{
+		auto is_space = [] (char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+
+		auto& data = field.data();
+		size_t j = 0;
+		while(j < data.size())
+		{
+			while(begin != end && (is_space(*begin) || *begin == '+'))	// from_chars rejects leading '+'
+				++begin;
+			if(begin == end)
+				break;
+
+			auto result = std::from_chars(begin, end, data[j]);
+			if(result.ec != std::errc{})
+			{
+				Logger::error() << "Field " << field.name() << " in file " << source
+								<< " contains a malformed value at index " << j << ".";
+				throw std::runtime_error("Malformed field data in ensemble file");
+			}
+			begin = result.ptr;
+			++j;
+		}
+
+		if(j != data.size())
+		{
+			Logger::error() << "Field " << field.name() << " in file " << source
+							<< " is incomplete. Read " << j << " of " << data.size() << " values.";
+			throw std::runtime_error("Incomplete field data in ensemble file");
+		}
+	}
+
+	void io_util::read_text_field(const fs::path& source, int field_index, const Field& layout, int first_row, Field& rows)
+	{
+		auto file = MappedFile{source};
+		auto lines = layout.height()*layout.depth();
+		auto begin = skip_lines(file.begin(), file.end(), text_header_lines + (lines+1)*field_index + first_row);	// Skip header, fields and rows
+		parse_values(begin, skip_lines(begin, file.end(), rows.height()*rows.depth()), source, rows);
+	}
+
+	void io_util::read_text_field(const fs::path& source, const FieldExtent& extent, int first_row, Field& rows)
+	{
+		auto file = MappedFile{source};
+		if(extent._begin > extent._end || extent._end > file.size())
+		{
+			Logger::error() << "Field " << rows.name() << " lies outside of file " << source
+							<< ". Begin: " << extent._begin << " end: " << extent._end << " file size: " << file.size();
+			throw std::out_of_range("Field extent exceeds ensemble file");
+		}
+		auto field_end = file.begin() + extent._end;
+		auto begin = skip_lines(file.begin() + extent._begin, field_end, first_row);
+		parse_values(begin, skip_lines(begin, field_end, rows.height()*rows.depth()), source, rows);
+	}
+
+	bool io_util::read_field_cache(const fs::path& cache, const fs::path& source, int field_index, const Field& layout, int first_row, Field& rows)
+	{
+		auto ifs = std::ifstream{cache, std::ios::binary};
+		if(!ifs)
+			return false;
+
+		auto header = FieldCacheHeader{};
+		if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header))
+				|| std::memcmp(header._magic, field_cache_magic, sizeof(field_cache_magic)) != 0
+				|| header._version != field_cache_version)
+		{
+			Logger::warning() << "Ignoring invalid field cache " << cache;
+			return false;
+		}
+
+		// Outdated
+		if(header._source_size != fs::file_size(source) || header._source_mtime != source_mtime(source))
+			return false;
+
+		if(header._width != layout.width() || header._height != layout.height() || header._depth != layout.depth()
+				|| layout.point_dimension() != 1 || field_index < 0 || field_index >= header._num_fields
+				|| rows.width() != layout.width() || rows.point_dimension() != 1
+				|| first_row < 0 || first_row + rows.height()*rows.depth() > layout.height()*layout.depth())
+		{
+			Logger::warning() << "Field cache " << cache << " does not match the layout of field " << layout.name();
+			return false;
+		}
+
+		auto& data = rows.data();
+		auto block_size = static_cast<std::streamoff>(layout.volume()) * static_cast<std::streamoff>(sizeof(float));
+		auto row_size = static_cast<std::streamoff>(layout.width()) * static_cast<std::streamoff>(sizeof(float));
+		ifs.seekg(static_cast<std::streamoff>(sizeof(header)) + field_index * block_size + first_row * row_size);
+		return static_cast<bool>(ifs.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(float))));
+	}
+
+	bool io_util::write_field_cache(const fs::path& cache, const fs::path& source, const std::vector<Field>& layouts)
+	{
+		if(layouts.empty())
+			return false;
+
+		const auto& layout = layouts.front();
+		if(layout.point_dimension() != 1
+				|| !std::all_of(layouts.begin(), layouts.end(), [&layout] (const Field& f) { return f.equal_layout(layout); }))
+		{
+			Logger::warning() << "Field cache " << cache << " cannot store fields of differing layout.";
+			return false;
+		}
+
+		auto header = FieldCacheHeader{};
+		std::memcpy(header._magic, field_cache_magic, sizeof(field_cache_magic));
+		header._version = field_cache_version;
+		header._width = layout.width();
+		header._height = layout.height();
+		header._depth = layout.depth();
+		header._num_fields = static_cast<std::int32_t>(layouts.size());
+		header._source_size = fs::file_size(source);
+		header._source_mtime = source_mtime(source);
+
+		auto error = std::error_code{};
+		fs::create_directories(cache.parent_path(), error);
+		if(error)
+		{
+			Logger::warning() << "Field cache directory " << cache.parent_path() << " could not be created: " << error.message();
+			return false;
+		}
+
+		auto temporary = cache;
+		temporary += ".tmp";
+		{
+			auto ofs = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+			ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+			// Parse and write one field at a time
+			// A malformed field fails the whole cache, but must not fail reads of the other fields, which are then parsed on their own
+			try
+			{
+				auto file = MappedFile{source};
+				auto buffer = Field{layout, true};
+				auto lines = layout.height()*layout.depth();
+				auto begin = skip_lines(file.begin(), file.end(), text_header_lines);	// Skip header
+				for(const auto& field : layouts)
+				{
+					auto end = skip_lines(begin, file.end(), lines);
+					buffer.set_name(field.name());
+					parse_values(begin, end, source, buffer);
+					ofs.write(reinterpret_cast<const char*>(buffer.data().data()), static_cast<std::streamsize>(buffer.data().size() * sizeof(float)));
+					begin = skip_lines(end, file.end(), 1);	// Skip line between fields
+				}
+			}
+			catch(const std::runtime_error& e)
+			{
+				Logger::warning() << "Field cache " << cache << " could not be built from file " << source << ": " << e.what();
+				ofs.close();
+				fs::remove(temporary, error);
+				return false;
+			}
+
+			if(!ofs)
+			{
+				Logger::warning() << "Field cache " << cache << " could not be written.";
+				ofs.close();
+				fs::remove(temporary, error);
+				return false;
+			}
+		}
+
+		fs::rename(temporary, cache, error);
+		return !error;
+	}
+
+	std::vector<io_util::FieldExtent> io_util::build_field_index(const fs::path& source, int num_fields, int lines_per_field)
+	{
+		auto extents = std::vector<FieldExtent>{};
+		extents.reserve(static_cast<size_t>(std::max(num_fields, 0)));
+
+		auto file = MappedFile{source};
+		auto begin = skip_lines(file.begin(), file.end(), text_header_lines);	// Skip header
+		for(int f = 0; f < num_fields; ++f)
+		{
+			auto end = skip_lines(begin, file.end(), lines_per_field);
+			extents.push_back({static_cast<std::uint64_t>(begin - file.begin()), static_cast<std::uint64_t>(end - file.begin())});
+			begin = skip_lines(end, file.end(), 1);	// Skip line between fields
+		}
+		return extents;
+	}
+
+	bool io_util::read_field_index(const fs::path& index, const fs::path& source, int num_fields, int lines_per_field, std::vector<FieldExtent>& extents)
+	{
+		auto ifs = std::ifstream{index, std::ios::binary};
+		if(!ifs)
+			return false;
+
+		auto header = FieldIndexHeader{};
+		if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header))
+				|| std::memcmp(header._magic, field_index_magic, sizeof(field_index_magic)) != 0
+				|| header._version != field_index_version)
+		{
+			Logger::warning() << "Ignoring invalid field index " << index;
+			return false;
+		}
+
+		// Outdated or built for a different layout
+		if(header._source_size != fs::file_size(source) || header._source_mtime != source_mtime(source)
+				|| header._num_fields != num_fields || header._lines_per_field != lines_per_field)
+			return false;
+
+		extents.resize(static_cast<size_t>(num_fields));
+		return static_cast<bool>(ifs.read(reinterpret_cast<char*>(extents.data()), static_cast<std::streamsize>(extents.size() * sizeof(FieldExtent))));
+	}
+
+	bool io_util::write_field_index(const fs::path& index, const fs::path& source, int lines_per_field, const std::vector<FieldExtent>& extents)
+	{
+		auto header = FieldIndexHeader{};
+		std::memcpy(header._magic, field_index_magic, sizeof(field_index_magic));
+		header._version = field_index_version;
+		header._num_fields = static_cast<std::int32_t>(extents.size());
+		header._lines_per_field = lines_per_field;
+		header._source_size = fs::file_size(source);
+		header._source_mtime = source_mtime(source);
+
+		auto error = std::error_code{};
+		fs::create_directories(index.parent_path(), error);
+		if(error)
+		{
+			Logger::warning() << "Field index directory " << index.parent_path() << " could not be created: " << error.message();
+			return false;
+		}
+
+		auto temporary = index;
+		temporary += ".tmp";
+		{
+			auto ofs = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+			ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			ofs.write(reinterpret_cast<const char*>(extents.data()), static_cast<std::streamsize>(extents.size() * sizeof(FieldExtent)));
+			if(!ofs)
+			{
+				Logger::warning() << "Field index " << index << " could not be written.";
+				ofs.close();
+				fs::remove(temporary, error);
+				return false;
+			}
+		}
+
+		fs::rename(temporary, index, error);
+		return !error;
+	}
+
+	bool io_util::read_manifest(const fs::path& manifest, const fs::path& root, EnsembleManifest& content)
+	{
+		auto ifs = std::ifstream{manifest};
+		if(!ifs)
+			return false;
+		auto buffer = std::stringstream{};
+		buffer << ifs.rdbuf();
+
+		auto line = std::string{};
+		if(!std::getline(buffer, line) || line != manifest_signature)
+		{
+			Logger::warning() << "Ignoring invalid ensemble manifest " << manifest;
+			return false;
+		}
+
+		auto num_directories = size_t{0};
+		if(!(buffer >> content._num_simulations >> content._num_steps >> num_directories)
+				|| content._num_simulations < 0 || content._num_steps < 0)
+		{
+			Logger::warning() << "Ignoring invalid ensemble manifest " << manifest;
+			return false;
+		}
+
+		// Directories with their modification time
+		content._directories.clear();
+		for(size_t d = 0; d < num_directories; ++d)
+		{
+			auto mtime = std::int64_t{};
+			if(!(buffer >> mtime) || !std::getline(buffer >> std::ws, line))
+				return false;
+
+			auto directory = root / line;
+			auto error = std::error_code{};
+			if(!fs::is_directory(directory, error)
+					|| fs::last_write_time(directory, error).time_since_epoch().count() != mtime
+					|| error)
+				return false;	// Outdated
+			content._directories.emplace_back(directory, mtime);
+		}
+
+		// Member files
+		auto num_files = static_cast<size_t>(content._num_simulations) * static_cast<size_t>(content._num_steps);
+		content._files.clear();
+		content._files.reserve(num_files);
+		while(content._files.size() < num_files && std::getline(buffer, line))
+			if(!line.empty())
+				content._files.push_back(root / line);
+
+		return content._files.size() == num_files;
+	}
+
+	bool io_util::write_manifest(const fs::path& manifest, const fs::path& root, const EnsembleManifest& content)
+	{
+		auto relative = [prefix_length = root.string().size()] (const fs::path& path)
+		{
+			auto relative = path.string().substr(prefix_length);
+			return relative.empty() ? std::string{"."} : relative.substr(relative.find_first_not_of('/'));
+		};
+
+		auto error = std::error_code{};
+		fs::create_directories(manifest.parent_path(), error);
+		if(error)
+		{
+			Logger::warning() << "Ensemble manifest directory " << manifest.parent_path() << " could not be created: " << error.message();
+			return false;
+		}
+
+		auto temporary = manifest;
+		temporary += ".tmp";
+		{
+			auto ofs = std::ofstream{temporary, std::ios::trunc};
+			ofs << manifest_signature << '\n'
+				<< content._num_simulations << ' ' << content._num_steps << ' ' << content._directories.size() << '\n';
+			for(const auto& directory : content._directories)
+				ofs << directory.second << ' ' << relative(directory.first) << '\n';
+			for(const auto& file : content._files)
+				ofs << relative(file) << '\n';
+
+			if(!ofs)
+			{
+				Logger::warning() << "Ensemble manifest " << manifest << " could not be written.";
+				ofs.close();
+				fs::remove(temporary, error);
+				return false;
+			}
+		}
+
+		fs::rename(temporary, manifest, error);
+		return !error;
+	}
+
+	fs::path io_util::result_cache_path(const fs::path& cache_root, const std::string& key)
+	{
+		// 64 bit FNV-1a, which does not depend on the standard library implementation like std::hash
+		auto hash = std::uint64_t{14695981039346656037ull};
+		for(auto c : key)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+
+		auto name = std::ostringstream{};
+		name << std::hex << std::setw(16) << std::setfill('0') << hash << result_cache_extension;
+		return cache_root / "results" / name.str();
+	}
+
+	bool io_util::read_result_cache(const fs::path& cache, const std::string& key, std::vector<Field>& fields)
+	{
+		auto ifs = std::ifstream{cache, std::ios::binary};
+		if(!ifs)
+			return false;
+
+		auto header = ResultCacheHeader{};
+		if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header))
+				|| std::memcmp(header._magic, result_cache_magic, sizeof(result_cache_magic)) != 0
+				|| header._version != result_cache_version
+				|| header._width < 1 || header._height < 1 || header._depth < 1 || header._num_fields < 0)
+		{
+			Logger::warning() << "Ignoring invalid result cache " << cache;
+			return false;
+		}
+
+		// Another analysis with the same hash
+		if(header._key_size != key.size())
+			return false;
+		auto stored_key = std::string(key.size(), '\0');
+		if(!ifs.read(&stored_key[0], static_cast<std::streamsize>(stored_key.size())) || stored_key != key)
+			return false;
+
+		auto results = std::vector<Field>{};
+		for(std::int32_t f = 0; f < header._num_fields; ++f)
+		{
+			std::int32_t point_dimension;
+			std::int32_t name_size;
+			if(!ifs.read(reinterpret_cast<char*>(&point_dimension), sizeof(point_dimension))
+					|| !ifs.read(reinterpret_cast<char*>(&name_size), sizeof(name_size))
+					|| point_dimension < 1 || name_size < 0)
+			{
+				Logger::warning() << "Ignoring invalid result cache " << cache;
+				return false;
+			}
+			auto name = std::string(static_cast<size_t>(name_size), '\0');
+			ifs.read(&name[0], name_size);
+
+			results.emplace_back(point_dimension, header._width, header._height, header._depth, true);
+			results.back().set_name(name);
+			auto& data = results.back().data();
+			if(!ifs.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(float))))
+			{
+				Logger::warning() << "Ignoring truncated result cache " << cache;
+				return false;
+			}
+		}
+
+		// The modification time orders the caches for eviction
+		auto error = std::error_code{};
+		fs::last_write_time(cache, fs::file_time_type::clock::now(), error);
+
+		fields = std::move(results);
+		return true;
+	}
+
+	bool io_util::write_result_cache(const fs::path& cache, const std::string& key, const std::vector<Field>& fields)
+	{
+		if(fields.empty())
+			return false;
+
+		const auto& layout = fields.front();
+		auto header = ResultCacheHeader{};
+		std::memcpy(header._magic, result_cache_magic, sizeof(result_cache_magic));
+		header._version = result_cache_version;
+		header._width = layout.width();
+		header._height = layout.height();
+		header._depth = layout.depth();
+		header._num_fields = static_cast<std::int32_t>(fields.size());
+		header._key_size = key.size();
+
+		auto error = std::error_code{};
+		fs::create_directories(cache.parent_path(), error);
+		if(error)
+		{
+			Logger::warning() << "Result cache directory " << cache.parent_path() << " could not be created: " << error.message();
+			return false;
+		}
+
+		auto temporary = cache;
+		temporary += ".tmp";
+		{
+			auto ofs = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+			ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			ofs.write(key.data(), static_cast<std::streamsize>(key.size()));
+			for(const auto& field : fields)
+			{
+				auto point_dimension = static_cast<std::int32_t>(field.point_dimension());
+				auto name_size = static_cast<std::int32_t>(field.name().size());
+				ofs.write(reinterpret_cast<const char*>(&point_dimension), sizeof(point_dimension));
+				ofs.write(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
+				ofs.write(field.name().data(), name_size);
+				ofs.write(reinterpret_cast<const char*>(field.data().data()), static_cast<std::streamsize>(field.data().size() * sizeof(float)));
+			}
+
+			if(!ofs)
+			{
+				Logger::warning() << "Result cache " << cache << " could not be written.";
+				ofs.close();
+				fs::remove(temporary, error);
+				return false;
+			}
+		}
+
+		fs::rename(temporary, cache, error);
+		return !error;
+	}
+
+	void io_util::evict_result_caches(const fs::path& directory, std::uintmax_t limit)
+	{
+		struct Entry
+		{
+			fs::path _path;
+			fs::file_time_type _last_use;
+			std::uintmax_t _size;
+		};
+
+		auto error = std::error_code{};
+		auto entries = std::vector<Entry>{};
+		auto total = std::uintmax_t{0};
+		for(const auto& file : fs::directory_iterator{directory, error})
+		{
+			if(file.path().extension() != result_cache_extension)
+				continue;
+			auto size = fs::file_size(file.path(), error);
+			if(error)
+				continue;
+			entries.push_back({file.path(), fs::last_write_time(file.path(), error), size});
+			total += size;
+		}
+		if(total <= limit)
+			return;
+
+		// Remove the least recently used caches first
+		std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) { return a._last_use < b._last_use; });
+		for(const auto& entry : entries)
+		{
+			if(total <= limit)
+				break;
+			if(fs::remove(entry._path, error))
+			{
+				total -= entry._size;
+				Logger::debug() << "Result cache " << entry._path << " has been evicted.";
+			}
+		}
+	}
+}
@@ -0,0 +1,276 @@
+#ifndef IO_UTIL_H
+#define IO_UTIL_H
+
+#include <experimental/filesystem>
+#include <vector>
+#include <cstdint>
+
+#include "field.h"
+
+namespace vis
+{
+	namespace fs = std::experimental::filesystem;
+	/**
+	 * General utility functions for reading ensemble member files and their binary caches.
+	 */
+	namespace io_util
+	{
+		/// Number of lines in front of the first field of an ensemble member text file.
+		static constexpr int text_header_lines = 3;
+		/// Identifies binary field caches. Files with a different magic are never read.
+		static constexpr char field_cache_magic[8] = {'V', 'I', 'S', 'F', 'C', 'A', 'C', 'H'};
+		/// Has to be increased whenever the cache layout changes. Also rejects caches written with a different byte order.
+		static constexpr std::uint32_t field_cache_version = 1;
+		/// Identifies field offset indices.
+		static constexpr char field_index_magic[8] = {'V', 'I', 'S', 'F', 'I', 'N', 'D', 'X'};
+		/// Has to be increased whenever the index layout changes.
+		static constexpr std::uint32_t field_index_version = 1;
+		/// First line of every ensemble manifest, including the manifest version.
+		static constexpr char manifest_signature[] = "VISMANIFEST 1";
+		/// Identifies cached analysis results.
+		static constexpr char result_cache_magic[8] = {'V', 'I', 'S', 'R', 'E', 'S', 'L', 'T'};
+		/// Has to be increased whenever the result cache layout changes.
+		static constexpr std::uint32_t result_cache_version = 1;
+		/// Extension of cached analysis results. Eviction only removes files with this extension.
+		static constexpr char result_cache_extension[] = ".result";
+
+		/**
+		 * @brief The FieldCacheHeader struct is the layout header at the beginning of a binary field cache.
+		 * It is followed by num_fields contiguous blocks of width*height*depth floats, one for each field.
+		 */
+		struct FieldCacheHeader
+		{
+			char _magic[8];
+			std::uint32_t _version;
+			std::int32_t _width;
+			std::int32_t _height;
+			std::int32_t _depth;
+			std::int32_t _num_fields;
+			std::uint32_t _reserved;
+			std::uint64_t _source_size;
+			std::int64_t _source_mtime;
+		};
+
+		/**
+		 * @brief The FieldIndexHeader struct is the header at the beginning of a field offset index.
+		 * It is followed by num_fields FieldExtents.
+		 */
+		struct FieldIndexHeader
+		{
+			char _magic[8];
+			std::uint32_t _version;
+			std::int32_t _num_fields;
+			std::int32_t _lines_per_field;
+			std::uint32_t _reserved;
+			std::uint64_t _source_size;
+			std::int64_t _source_mtime;
+		};
+
+		/**
+		 * @brief The FieldExtent struct locates the data of one field inside of an ensemble member text file.
+		 */
+		struct FieldExtent
+		{
+			std::uint64_t _begin;	///< Byte offset of the first value.
+			std::uint64_t _end;		///< Byte offset past the last line of values.
+		};
+
+		/**
+		 * @brief The ResultCacheHeader struct is the header at the beginning of cached analysis results.
+		 * It is followed by the key_size characters of the key and num_fields fields. Each field consists of its point dimension
+		 * and the length of its name as std::int32_t, its name and width*height*depth*point dimension floats.
+		 */
+		struct ResultCacheHeader
+		{
+			char _magic[8];
+			std::uint32_t _version;
+			std::int32_t _width;
+			std::int32_t _height;
+			std::int32_t _depth;
+			std::int32_t _num_fields;
+			std::uint32_t _reserved;
+			std::uint64_t _key_size;
+		};
+
+		/**
+		 * @brief The EnsembleManifest struct records the directory layout of an ensemble.
+		 */
+		struct EnsembleManifest
+		{
+			int _num_simulations;
+			int _num_steps;
+			/// The scanned directories and their modification times when they were scanned.
+			std::vector<std::pair<fs::path, std::int64_t>> _directories;
+			/// The ensemble member files, ordered by time step, then by simulation.
+			std::vector<fs::path> _files;
+		};
+
+		/**
+		 * @brief cache_path Returns the location of the cache file belonging to source inside of cache_root.
+		 * The absolute path of source is mirrored below cache_root, so caches of different ensembles do not collide.
+		 * @param cache_root The root directory of all caches.
+		 * @param source The file that is cached.
+		 * @param extension The extension that distinguishes different kinds of caches of the same file.
+		 */
+		fs::path cache_path(const fs::path& cache_root, const fs::path& source, const std::string& extension);
+
+		/**
+		 * @brief source_mtime Returns the last modification time of a file as a plain number for storing it in caches.
+		 */
+		std::int64_t source_mtime(const fs::path& source);
+
+		/**
+		 * @brief read_member_header Reads the layout data from the first two lines of an ensemble member text file.
+		 * Throws, if the header is malformed.
+		 * @return The layouts (and names) of all fields stored in the file. Their data is not initialized.
+		 */
+		std::vector<Field> read_member_header(const fs::path& source);
+
+		/**
+		 * @brief skip_lines Returns a pointer to the beginning of the line that lies count lines after begin.
+		 * Returns end, if the range contains less lines.
+		 */
+		const char* skip_lines(const char* begin, const char* end, int count);
+
+		/**
+		 * @brief parse_values Parses whitespace separated floats from a range of characters into field.
+		 * Nothing is allocated per value, the floats are converted in place using std::from_chars.
+		 * Throws, if the range contains less values than the field holds or if a value is malformed.
+		 * @param begin The first character of the range.
+		 * @param end The character past the last one of the range.
+		 * @param source The file the range belongs to. Used for error messages.
+		 * @param field The initialized field that receives the data.
+		 */
+		void parse_values(const char* begin, const char* end, const fs::path& source, Field& field);
+
+		/**
+		 * @brief read_text_field Reads consecutive rows of a single field from an ensemble member text file.
+		 * The file is memory mapped and parsed straight from the mapped pages.
+		 * @param source The ensemble member file.
+		 * @param field_index The index of the field inside of the file.
+		 * @param layout The layout of the fields stored in the file.
+		 * @param first_row The first row that is read. Rows are numbered across layers (y + z*height).
+		 * @param rows The initialized field that receives the data. Its width has to match the layout,
+		 * it receives rows.height()*rows.depth() rows.
+		 */
+		void read_text_field(const fs::path& source, int field_index, const Field& layout, int first_row, Field& rows);
+
+		/**
+		 * @brief read_text_field Reads consecutive rows of a single field from an ensemble member text file using a known location.
+		 * Only the pages spanned by the requested rows are touched.
+		 * @param source The ensemble member file.
+		 * @param extent The location of the fields data, as found by build_field_index.
+		 * @param first_row The first row that is read. Rows are numbered across layers (y + z*height).
+		 * @param rows The initialized field that receives the data.
+		 */
+		void read_text_field(const fs::path& source, const FieldExtent& extent, int first_row, Field& rows);
+
+		/**
+		 * @brief read_field_cache Reads consecutive rows of a single field from the binary cache of an ensemble member file.
+		 * @param cache The binary cache file.
+		 * @param source The ensemble member file the cache was created from.
+		 * @param field_index The index of the field inside of the cache.
+		 * @param layout The layout of the fields stored in the cache.
+		 * @param first_row The first row that is read. Rows are numbered across layers (y + z*height).
+		 * @param rows The initialized field that receives the data.
+		 * @return False, if the cache does not exist, is outdated compared to source or does not match the layout.
+		 */
+		bool read_field_cache(const fs::path& cache, const fs::path& source, int field_index, const Field& layout, int first_row, Field& rows);
+
+		/**
+		 * @brief write_field_cache Builds the binary cache of an ensemble member file from its text.
+		 * The fields are parsed one after another, so only a single field is held in memory.
+		 * The cache is written to a temporary file first and then renamed, so readers never see partial caches.
+		 * @param cache The binary cache file.
+		 * @param source The ensemble member file.
+		 * @param layouts The layouts (and names) of the fields stored in the file. All of them have to share the same layout.
+		 * @return False, if the cache could not be written, also if any field of the file is malformed or incomplete.
+		 */
+		bool write_field_cache(const fs::path& cache, const fs::path& source, const std::vector<Field>& layouts);
+
+		/**
+		 * @brief build_field_index Locates the data of every field inside of an ensemble member text file.
+		 * @param source The ensemble member file.
+		 * @param num_fields The number of fields stored in the file.
+		 * @param lines_per_field The number of lines each field occupies (height*depth).
+		 * @return The location of each field in order of their appearance in the file.
+		 */
+		std::vector<FieldExtent> build_field_index(const fs::path& source, int num_fields, int lines_per_field);
+
+		/**
+		 * @brief read_field_index Reads the field offset index of an ensemble member file.
+		 * @param index The index file.
+		 * @param source The ensemble member file the index was built from.
+		 * @param num_fields The number of fields the index has to contain.
+		 * @param lines_per_field The number of lines each field occupies (height*depth).
+		 * @param extents Receives the location of each field.
+		 * @return False, if the index does not exist, is outdated compared to source or was built for a different layout.
+		 */
+		bool read_field_index(const fs::path& index, const fs::path& source, int num_fields, int lines_per_field, std::vector<FieldExtent>& extents);
+
+		/**
+		 * @brief write_field_index Stores the field offset index of an ensemble member file.
+		 * @param index The index file.
+		 * @param source The ensemble member file the index was built from.
+		 * @param lines_per_field The number of lines each field occupies (height*depth).
+		 * @param extents The location of each field.
+		 * @return False, if the index could not be written.
+		 */
+		bool write_field_index(const fs::path& index, const fs::path& source, int lines_per_field, const std::vector<FieldExtent>& extents);
+
+		/**
+		 * @brief read_manifest Reads the manifest of an ensemble.
+		 * The manifest is read at once and only the recorded directories are inspected for modifications.
+		 * @param manifest The manifest file.
+		 * @param root The ensemble root directory. All paths in the manifest are relative to it.
+		 * @param content Receives the manifest.
+		 * @return False, if the manifest does not exist, is malformed or one of the recorded directories was modified.
+		 */
+		bool read_manifest(const fs::path& manifest, const fs::path& root, EnsembleManifest& content);
+
+		/**
+		 * @brief write_manifest Stores the manifest of an ensemble.
+		 * @param manifest The manifest file.
+		 * @param root The ensemble root directory. All paths in content have to be located below it.
+		 * @param content The manifest.
+		 * @return False, if the manifest could not be written.
+		 */
+		bool write_manifest(const fs::path& manifest, const fs::path& root, const EnsembleManifest& content);
+
+		/**
+		 * @brief result_cache_path Returns the location of cached analysis results inside of cache_root.
+		 * The file is named after a hash of the key, so keys of any length map to short file names.
+		 * @param cache_root The root directory of all caches.
+		 * @param key Describes the analysis and all of its inputs, including the modification times of the analysed files.
+		 */
+		fs::path result_cache_path(const fs::path& cache_root, const std::string& key);
+
+		/**
+		 * @brief read_result_cache Reads cached analysis results and marks them as recently used for evict_result_caches.
+		 * @param cache The result cache file.
+		 * @param key The key the results have to be stored with. Guards against hash collisions.
+		 * @param fields Receives the results.
+		 * @return False, if the cache does not exist, is malformed or was stored with another key.
+		 */
+		bool read_result_cache(const fs::path& cache, const std::string& key, std::vector<Field>& fields);
+
+		/**
+		 * @brief write_result_cache Stores analysis results.
+		 * The results are written to a temporary file first and then renamed, so readers never see partial results.
+		 * @param cache The result cache file.
+		 * @param key The key that read_result_cache has to be called with.
+		 * @param fields The results. All of them have to share the same width, height and depth.
+		 * @return False, if the results could not be written.
+		 */
+		bool write_result_cache(const fs::path& cache, const std::string& key, const std::vector<Field>& fields);
+
+		/**
+		 * @brief evict_result_caches Removes the least recently used result caches from a directory, until the rest fits into limit.
+		 * @param directory The directory result caches are stored in.
+		 * @param limit The maximum number of bytes of all result caches in directory.
+		 */
+		void evict_result_caches(const fs::path& directory, std::uintmax_t limit);
+	}
+}
+
+#endif // IO_UTIL_H
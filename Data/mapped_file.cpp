@@ -0,0 +1,90 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+namespace vis
+{
+	MappedFile::MappedFile(const fs::path& path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+		{
+			Logger::error() << "File " << path << " could not be opened for mapping: " << std::strerror(errno);
+			throw std::runtime_error("File could not be opened");
+		}
+
+		struct stat status{};
+		if(::fstat(fd, &status) != 0)
+		{
+			Logger::error() << "File " << path << " could not be inspected for mapping: " << std::strerror(errno);
+			::close(fd);
+			throw std::runtime_error("File could not be inspected");
+		}
+		_size = static_cast<size_t>(status.st_size);
+
+		// Empty files cannot be mapped, but are valid (empty) ranges anyway
+		if(_size > 0)
+		{
+			void* address = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(address == MAP_FAILED)
+			{
+				Logger::error() << "File " << path << " could not be mapped: " << std::strerror(errno);
+				::close(fd);
+				throw std::runtime_error("File could not be mapped");
+			}
+			::madvise(address, _size, MADV_SEQUENTIAL);	// Only a hint, failing is harmless
+			_data = static_cast<const char*>(address);
+		}
+
+		::close(fd);	// The mapping stays valid after closing
+	}
+
+	MappedFile::MappedFile(MappedFile&& other)
+		: _data{other._data},
+		  _size{other._size}
+	{
+		other._data = nullptr;
+		other._size = 0;
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other)
+	{
+		if(this != &other)
+		{
+			unmap();
+			_data = other._data;
+			_size = other._size;
+			other._data = nullptr;
+			other._size = 0;
+		}
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		unmap();
+	}
+
+	const char* MappedFile::begin() const	{ return _data; }
+
+	const char* MappedFile::end() const		{ return _data + _size; }
+
+	size_t MappedFile::size() const			{ return _size; }
+
+	void MappedFile::unmap()
+	{
+		if(_data)
+			::munmap(const_cast<char*>(_data), _size);
+		_data = nullptr;
+		_size = 0;
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <experimental/filesystem>
+#include <cstddef>
+
+namespace vis
+{
+	namespace fs = std::experimental::filesystem;
+	/**
+	 * @brief The MappedFile class provides RAII style read-only memory mapping of a file.
+	 * The mapped pages are served by the kernel page cache, so repeatedly mapping the same file does not copy its content.
+	 */
+	class MappedFile
+	{
+	public:
+		/**
+		 * @brief MappedFile Maps the whole file at path into memory.
+		 * Throws, if the file cannot be opened or mapped.
+		 */
+		explicit MappedFile(const fs::path& path);
+
+		/**
+		 * @brief MappedFile Move constructor.
+		 * Takes the mapping of other.
+		 */
+		MappedFile(MappedFile&& other);
+		/**
+		 * @brief operator = Move assignment operator.
+		 * Unmaps the currently held file and takes the mapping of other.
+		 */
+		MappedFile& operator=(MappedFile&& other);
+
+		MappedFile(const MappedFile& other) = delete;
+		MappedFile& operator=(const MappedFile& other) = delete;
+
+		/**
+		 * @brief ~MappedFile Unmaps the file.
+		 */
+		~MappedFile();
+
+		/// @brief Returns a pointer to the first character of the file.
+		const char* begin() const;
+		/// @brief Returns a pointer past the last character of the file.
+		const char* end() const;
+		/// @brief Returns the size of the file in bytes.
+		size_t size() const;
+
+	private:
+		void unmap();
+
+		const char* _data{nullptr};
+		size_t _size{0};
+	};
+}
+
+#endif // MAPPED_FILE_H
@@ -42,108 +42,663 @@ namespace vis
 
 	float math_util::mean(const std::vector<float>& samples)
 	{
-		float sum = 0.f;
-		for(const auto& sample : samples)
-			sum += sample;
-		return sum / samples.size();
+		return moments(samples)._mean;
 	}
 
 	float math_util::variance(const std::vector<float>& samples, float mean)
 	{
-		float sum = 0.f;
-		for(const auto& sample : samples)
-			sum += std::pow(mean - sample, 2);
-		return sum / samples.size();
+		return variance(moments(samples), mean);
+	}
+
+	void math_util::welford_update(RunningMoments& moments, const std::vector<float>& samples)
+	{
+		if(moments._count == 0)
+		{
+			moments._mean.assign(samples.size(), 0.);
+			moments._m2.assign(samples.size(), 0.);
+		}
+		Expects(moments._mean.size() == samples.size());
+
+		++moments._count;
+		for(size_t i = 0; i < samples.size(); ++i)
+		{
+			auto delta = samples[i] - moments._mean[i];
+			moments._mean[i] += delta / moments._count;
+			moments._m2[i] += delta * (samples[i] - moments._mean[i]);
+		}
+	}
+
+	void math_util::welford_update(RunningMoments& moments, const std::vector<const float*>& members, size_t begin, size_t end)
+	{
+		Expects(begin <= end && end <= moments._mean.size() && moments._m2.size() == moments._mean.size());
+
+		// Members in the outer loop, so the loop over points vectorizes
+		auto count = moments._count;
+		for(auto member : members)
+		{
+			++count;
+			for(auto i = begin; i < end; ++i)
+			{
+				auto delta = member[i] - moments._mean[i];
+				moments._mean[i] += delta / count;
+				moments._m2[i] += delta * (member[i] - moments._mean[i]);
+			}
+		}
+	}
+
+	void math_util::welford_merge(RunningMoments& moments, const RunningMoments& other)
+	{
+		if(other._count == 0)
+			return;
+		if(moments._count == 0)
+		{
+			moments = other;
+			return;
+		}
+		Expects(moments._mean.size() == other._mean.size());
+
+		auto count = moments._count + other._count;
+		for(size_t i = 0; i < moments._mean.size(); ++i)
+		{
+			auto delta = other._mean[i] - moments._mean[i];
+			moments._m2[i] += other._m2[i] + delta * delta * moments._count * other._count / count;
+			moments._mean[i] += delta * other._count / count;
+		}
+		moments._count = count;
+	}
+
+	void math_util::welford_remove(RunningMoments& moments, const RunningMoments& other)
+	{
+		if(other._count == 0)
+			return;
+		Expects(moments._count > other._count && moments._mean.size() == other._mean.size());
+
+		auto count = moments._count - other._count;
+		for(size_t i = 0; i < moments._mean.size(); ++i)
+		{
+			auto mean = (moments._mean[i] * moments._count - other._mean[i] * other._count) / count;
+			auto delta = other._mean[i] - mean;
+			moments._m2[i] = std::max(moments._m2[i] - other._m2[i] - delta * delta * count * other._count / moments._count, 0.);
+			moments._mean[i] = mean;
+		}
+		moments._count = count;
+	}
+
+	void math_util::prefix_moments_reset(PrefixMoments& moments, size_t num_steps, long members, const std::vector<float>& shift)
+	{
+		Expects(members > 0);
+		moments._num_steps = num_steps;
+		moments._members = members;
+		moments._shift = shift;
+		moments._sum.assign((num_steps + 1) * shift.size(), 0.);
+		moments._square_sum.assign((num_steps + 1) * shift.size(), 0.);
+	}
+
+	void math_util::prefix_moments_add(PrefixMoments& moments, size_t step, const std::vector<float>& samples)
+	{
+		Expects(step < moments._num_steps && samples.size() == moments._shift.size());
+
+		// Step s is summed into slot s + 1, slot 0 stays the empty sum
+		auto offset = (step + 1) * samples.size();
+		for(size_t i = 0; i < samples.size(); ++i)
+		{
+			auto x = static_cast<double>(samples[i]) - moments._shift[i];
+			moments._sum[offset + i] += x;
+			moments._square_sum[offset + i] += x * x;
+		}
+	}
+
+	void math_util::prefix_moments_accumulate(PrefixMoments& moments)
+	{
+		auto num_points = moments._shift.size();
+		for(size_t s = 1; s <= moments._num_steps; ++s)
+			for(size_t i = 0; i < num_points; ++i)
+			{
+				moments._sum[s * num_points + i] += moments._sum[(s - 1) * num_points + i];
+				moments._square_sum[s * num_points + i] += moments._square_sum[(s - 1) * num_points + i];
+			}
+	}
+
+	math_util::Moments math_util::prefix_moments_window(const PrefixMoments& moments, size_t point, size_t first_step, size_t count, size_t stride)
+	{
+		auto num_points = moments._shift.size();
+		Expects(count != 0 && point < num_points && first_step + (count - 1) * stride < moments._num_steps);
+
+		auto sum = 0.;
+		auto square_sum = 0.;
+		auto add_steps = [&moments, &sum, &square_sum, num_points, point] (size_t first, size_t last)
+		{
+			sum += moments._sum[last * num_points + point] - moments._sum[first * num_points + point];
+			square_sum += moments._square_sum[last * num_points + point] - moments._square_sum[first * num_points + point];
+		};
+		if(stride <= 1)
+			add_steps(first_step, first_step + count);
+		else
+			for(size_t c = 0; c < count; ++c)
+				add_steps(first_step + c * stride, first_step + c * stride + 1);
+
+		auto n = static_cast<double>(count) * moments._members;
+		auto mean = sum / n;
+		auto variance = std::max(square_sum / n - mean * mean, 0.);
+		return {static_cast<float>(mean + moments._shift[point]), static_cast<float>(variance)};
+	}
+
+	math_util::Moments math_util::moments(const float* samples, size_t count)
+	{
+		Expects(count != 0);
+		using simd_util::Float;
+		using simd_util::broadcast;
+
+		// Kahan summation in every lane: the compensation keeps the low order bits that the last addition lost
+		auto add = [] (Float& sum, Float& compensation, Float x)
+		{
+			auto y = x - compensation;
+			auto t = sum + y;
+			compensation = (t - sum) - y;
+			sum = t;
+		};
+
+		const auto shift = samples[0];
+		auto sum = broadcast(0.f);
+		auto sum_compensation = broadcast(0.f);
+		auto square_sum = broadcast(0.f);
+		auto square_sum_compensation = broadcast(0.f);
+		size_t s = 0;
+		for(; s + simd_util::lanes <= count; s += simd_util::lanes)
+		{
+			auto deviation = simd_util::load(samples + s) - broadcast(shift);
+			add(sum, sum_compensation, deviation);
+			add(square_sum, square_sum_compensation, deviation * deviation);
+		}
+
+		auto total = 0.;
+		auto square_total = 0.;
+		auto sums = simd_util::to_array(sum - sum_compensation);
+		auto square_sums = simd_util::to_array(square_sum - square_sum_compensation);
+		for(size_t l = 0; l < simd_util::lanes; ++l)
+		{
+			total += sums[l];
+			square_total += square_sums[l];
+		}
+		for(; s < count; ++s)
+		{
+			auto deviation = static_cast<double>(samples[s]) - shift;
+			total += deviation;
+			square_total += deviation * deviation;
+		}
+
+		auto mean_deviation = total / count;
+		return {static_cast<float>(shift + mean_deviation), static_cast<float>(std::max(0., square_total / count - mean_deviation * mean_deviation))};
+	}
+
+	float math_util::mean(const GMMHistogram& histogram)
+	{
+		auto sum = 0.f;
+		for(size_t b = 0; b < histogram._centers.size(); ++b)
+			sum += histogram._counts[b] * histogram._centers[b];
+		return sum / histogram._num_samples;
+	}
+
+	float math_util::variance(const GMMHistogram& histogram, float mean)
+	{
+		auto sum = 0.f;
+		for(size_t b = 0; b < histogram._centers.size(); ++b)
+			sum += histogram._counts[b] * square(histogram._centers[b] - mean);
+		return sum / histogram._num_samples + square(histogram._bin_width) / 12.f;
+	}
+
+	void math_util::bin_samples(const std::vector<float>& samples, unsigned num_bins, GMMHistogram& histogram)
+	{
+		Expects(num_bins != 0);
+		Expects(!samples.empty());
+
+		auto range = std::minmax_element(samples.begin(), samples.end());
+		auto lower = *range.first;
+		histogram._bin_width = (*range.second - lower) / num_bins;
+		histogram._num_samples = samples.size();
+
+		// Count into all bins, then drop the empty ones
+		auto& counts = histogram._counts;
+		counts.assign(num_bins, 0.f);
+		if(histogram._bin_width > 0.f)
+		{
+			for(const auto& s : samples)
+				counts[std::min(static_cast<size_t>((s - lower) / histogram._bin_width), static_cast<size_t>(num_bins - 1))] += 1.f;
+		}
+		else
+			counts.front() = static_cast<float>(samples.size());
+
+		auto& centers = histogram._centers;
+		centers.clear();
+		size_t filled = 0;
+		for(size_t b = 0; b < num_bins; ++b)
+		{
+			if(counts[b] == 0.f)
+				continue;
+			centers.push_back(lower + (b + .5f) * histogram._bin_width);
+			counts[filled++] = counts[b];
+		}
+		counts.resize(filled);
 	}
 
 	void math_util::em_step(const std::vector<float>& samples, std::vector<math_util::GMMComponent>& gmm)
 	{
-		auto sample_weights = std::vector<float>{};
-		sample_weights.resize(samples.size() * gmm.size());
+		auto workspace = GMMWorkspace{};
+		em_step(samples, gmm, workspace);
+	}
+
+	template<typename Components>
+	void math_util::em_step(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace)
+	{
+		em_expectation_step(samples, gmm, workspace);
+		em_maximization_step(samples, gmm, workspace);
+	}
+
+	template<typename Components>
+	float math_util::em_expectation_step(const std::vector<float>& samples, const Components& gmm, GMMWorkspace& workspace)
+	{
+		const auto num_components = gmm.size();
+		auto& sample_weights = workspace._sample_weights;
+		sample_weights.resize(samples.size() * num_components);
 
-		// E-step
-		{	// Scope i
-			size_t i = 0;
-			for(const auto& samp : samples)
+		auto likelihood = 0.f;
+		auto log_likelihood = 0.f;
+		workspace._density_evaluations += static_cast<long>(samples.size() * num_components);
+
+		for(size_t s = 0; s < samples.size(); ++s)
+		{
+			// Weighted component densities, their sum is the GMM density
+			auto* weights = &sample_weights[s * num_components];
+			auto sample_gmm_density = 0.f;
+			for(size_t c = 0; c < num_components; ++c)
 			{
-				auto sample_gmm_density = gmm_density(samp, gmm);
-				for(const auto& comp : gmm)
-					sample_weights[i++] = normal_density(samp, comp._mean, comp._variance) * comp._weight / sample_gmm_density;
+				weights[c] = gmm[c]._weight * normal_density(samples[s], gmm[c]._mean, gmm[c]._variance);
+				sample_gmm_density += weights[c];
 			}
+			for(size_t c = 0; c < num_components; ++c)
+				weights[c] /= sample_gmm_density;
+
+			likelihood += sample_gmm_density;
+			log_likelihood += std::log(sample_gmm_density);
 		}
 
+		workspace._likelihood = likelihood;
+		workspace._log_likelihood = log_likelihood;
+		return log_likelihood;
+	}
+
+	template<typename Components>
+	void math_util::em_maximization_step(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace)
+	{
+		const auto num_components = gmm.size();
+		const auto& sample_weights = workspace._sample_weights;
+		Expects(sample_weights.size() == samples.size() * num_components);
+
 		// M-step
-		for(unsigned c = 0; c < gmm.size(); ++c)
+		for(size_t c = 0; c < num_components; ++c)
 		{
 			// Sum of the membership weights of the current component
 			auto weight_sum = 0.f;
 
 			// Weight
 			for(size_t s = 0; s < samples.size(); ++s)
-				weight_sum += sample_weights[s * gmm.size() + c];
+				weight_sum += sample_weights[s * num_components + c];
 			gmm[c]._weight = weight_sum / samples.size();
 
 			// Mean
-			gmm[c]._mean = 0.f;
+			auto mean = 0.f;
 			for(size_t s = 0; s < samples.size(); ++s)
-				gmm[c]._mean += sample_weights[s * gmm.size() + c] * samples[s];
-			gmm[c]._mean /= weight_sum;
+				mean += sample_weights[s * num_components + c] * samples[s];
+			gmm[c]._mean = mean / weight_sum;
 
 			// Variance
-			gmm[c]._variance = 0.f;
+			auto variance = 0.f;
 			for(size_t s = 0; s < samples.size(); ++s)
-				gmm[c]._variance += sample_weights[s * gmm.size() + c] * square(samples[s] - gmm[c]._mean);
-			gmm[c]._variance /= weight_sum;
+				variance += sample_weights[s * num_components + c] * square(samples[s] - gmm[c]._mean);
+			gmm[c]._variance = variance / weight_sum;
 
 			// Avoid singularity (variance == 0 -> mean == NaN, weight == NaN, etc)
 			if(gmm[c]._variance <= std::numeric_limits<float>::min())
 			{
 				// Reset mean to a random sample and variance to the squared average deviation
-				if(fit_gmm_random_init)
-					gmm[c]._mean = pick_randomly(samples);
+				if(workspace._random_init)
+					gmm[c]._mean = pick_randomly(samples, workspace._random);
 				else // In case randomness is turned off, use the first sample to be constistent between runs
 					gmm[c]._mean = samples.front();
-				gmm[c]._variance = variance(samples, gmm[c]._mean);
+				gmm[c]._variance = math_util::variance(samples, gmm[c]._mean);
+			}
+		}
+	}
+
+	template<typename Components>
+	unsigned math_util::iterate_em(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace)
+	{
+		if(workspace._accelerated_em)
+			return iterate_squarem(samples, gmm, workspace);
+
+		// Iterate until difference in log-likelihood <= epsilon.
+		// Each expectation step also yields the log-likelihood of the preceding maximization step.
+		auto confidence = em_expectation_step(samples, gmm, workspace);
+		unsigned iterations = 0;
+		while(iterations < fit_gmm_max_iterations)
+		{
+			em_maximization_step(samples, gmm, workspace);
+			++iterations;
+			auto new_confidence = em_expectation_step(samples, gmm, workspace);
+			if(std::abs(confidence - new_confidence) < fit_gmm_log_likelihood_epsilon)
+				break;
+			confidence = new_confidence;
+		}
+		workspace._em_iterations += iterations;
+		return iterations;
+	}
+
+	float math_util::em_expectation_step(const GMMHistogram& histogram, const std::vector<GMMComponent>& gmm, GMMWorkspace& workspace)
+	{
+		const auto num_components = gmm.size();
+		const auto num_bins = histogram._centers.size();
+		auto& bin_weights = workspace._sample_weights;
+		bin_weights.resize(num_bins * num_components);
+
+		auto likelihood = 0.f;
+		auto log_likelihood = 0.f;
+		workspace._density_evaluations += static_cast<long>(num_bins * num_components);
+
+		for(size_t b = 0; b < num_bins; ++b)
+		{
+			auto* weights = &bin_weights[b * num_components];
+			auto bin_gmm_density = 0.f;
+			for(size_t c = 0; c < num_components; ++c)
+			{
+				weights[c] = gmm[c]._weight * normal_density(histogram._centers[b], gmm[c]._mean, gmm[c]._variance);
+				bin_gmm_density += weights[c];
 			}
+			for(size_t c = 0; c < num_components; ++c)
+				weights[c] /= bin_gmm_density;
+
+			likelihood += histogram._counts[b] * bin_gmm_density;
+			log_likelihood += histogram._counts[b] * std::log(bin_gmm_density);
 		}
+
+		workspace._likelihood = likelihood;
+		workspace._log_likelihood = log_likelihood;
+		return log_likelihood;
 	}
 
+	void math_util::em_maximization_step(const GMMHistogram& histogram, std::vector<GMMComponent>& gmm, GMMWorkspace& workspace)
+	{
+		const auto num_components = gmm.size();
+		const auto num_bins = histogram._centers.size();
+		const auto& bin_weights = workspace._sample_weights;
+		Expects(bin_weights.size() == num_bins * num_components);
+
+		// Sheppard's correction for the spread of the samples inside of their bins
+		const auto bin_variance = square(histogram._bin_width) / 12.f;
+		for(size_t c = 0; c < num_components; ++c)
+		{
+			auto weight_sum = 0.f;
+			auto mean = 0.f;
+			for(size_t b = 0; b < num_bins; ++b)
+			{
+				auto weight = histogram._counts[b] * bin_weights[b * num_components + c];
+				weight_sum += weight;
+				mean += weight * histogram._centers[b];
+			}
+			gmm[c]._weight = weight_sum / histogram._num_samples;
+			gmm[c]._mean = mean / weight_sum;
+
+			auto variance = 0.f;
+			for(size_t b = 0; b < num_bins; ++b)
+				variance += histogram._counts[b] * bin_weights[b * num_components + c] * square(histogram._centers[b] - gmm[c]._mean);
+			gmm[c]._variance = variance / weight_sum + bin_variance;
+
+			// Avoid singularity, like for unbinned samples
+			if(!(gmm[c]._variance > std::numeric_limits<float>::min()) || !std::isfinite(gmm[c]._mean))
+			{
+				gmm[c]._mean = histogram._centers.front();
+				gmm[c]._variance = math_util::variance(histogram, gmm[c]._mean);
+			}
+		}
+	}
+
+	unsigned math_util::iterate_em(const GMMHistogram& histogram, std::vector<GMMComponent>& gmm, GMMWorkspace& workspace)
+	{
+		if(workspace._accelerated_em)
+			return iterate_squarem(histogram, gmm, workspace);
+
+		auto confidence = em_expectation_step(histogram, gmm, workspace);
+		unsigned iterations = 0;
+		while(iterations < fit_gmm_max_iterations)
+		{
+			em_maximization_step(histogram, gmm, workspace);
+			++iterations;
+			auto new_confidence = em_expectation_step(histogram, gmm, workspace);
+			if(std::abs(confidence - new_confidence) < fit_gmm_log_likelihood_epsilon)
+				break;
+			confidence = new_confidence;
+		}
+		workspace._em_iterations += iterations;
+		return iterations;
+	}
+
+	template<typename Samples, typename Components>
+	unsigned math_util::iterate_squarem(const Samples& samples, Components& gmm, GMMWorkspace& workspace)
+	{
+		const auto num_components = gmm.size();
+		auto& history = workspace._em_history;
+		history.resize(3 * num_components);
+		auto* origin = &history[0];
+		auto* first = &history[num_components];
+		auto* second = &history[2 * num_components];
+
+		auto confidence = em_expectation_step(samples, gmm, workspace);
+		unsigned iterations = 0;
+		while(iterations < fit_gmm_max_iterations)
+		{
+			// Two plain EM steps, each one can already satisfy the stopping criterion
+			std::copy(gmm.begin(), gmm.end(), origin);
+			em_maximization_step(samples, gmm, workspace);
+			++iterations;
+			auto new_confidence = em_expectation_step(samples, gmm, workspace);
+			if(std::abs(confidence - new_confidence) < fit_gmm_log_likelihood_epsilon || iterations == fit_gmm_max_iterations)
+				break;
+			confidence = new_confidence;
+
+			std::copy(gmm.begin(), gmm.end(), first);
+			em_maximization_step(samples, gmm, workspace);
+			++iterations;
+			new_confidence = em_expectation_step(samples, gmm, workspace);
+			if(std::abs(confidence - new_confidence) < fit_gmm_log_likelihood_epsilon)
+				break;
+			confidence = new_confidence;
+
+			// Step length from the first change r and the change of the change v of all parameters (SqS3 scheme)
+			auto r_norm = 0.f;
+			auto v_norm = 0.f;
+			for(size_t c = 0; c < num_components; ++c)
+			{
+				r_norm += square(first[c]._mean - origin[c]._mean) + square(first[c]._variance - origin[c]._variance)
+						+ square(first[c]._weight - origin[c]._weight);
+				v_norm += square(gmm[c]._mean - 2 * first[c]._mean + origin[c]._mean)
+						+ square(gmm[c]._variance - 2 * first[c]._variance + origin[c]._variance)
+						+ square(gmm[c]._weight - 2 * first[c]._weight + origin[c]._weight);
+			}
+			if(!(v_norm > 0.f))
+				continue;
+			// alpha = -1 reproduces the second EM step, so only longer steps are tried
+			auto alpha = -std::sqrt(r_norm / v_norm);
+			if(!(alpha < -1.f))
+				continue;
+
+			// origin - 2 alpha r + alpha^2 v, the second EM step is kept to fall back to
+			auto extrapolate = [alpha] (float x0, float x1, float x2)
+			{
+				return x0 - 2 * alpha * (x1 - x0) + alpha * alpha * (x2 - 2 * x1 + x0);
+			};
+			std::copy(gmm.begin(), gmm.end(), second);
+			auto valid = true;
+			auto weight_sum = 0.f;
+			for(size_t c = 0; c < num_components; ++c)
+			{
+				gmm[c]._mean = extrapolate(origin[c]._mean, first[c]._mean, second[c]._mean);
+				gmm[c]._variance = extrapolate(origin[c]._variance, first[c]._variance, second[c]._variance);
+				gmm[c]._weight = extrapolate(origin[c]._weight, first[c]._weight, second[c]._weight);
+				valid = valid && std::isfinite(gmm[c]._mean) && gmm[c]._variance > std::numeric_limits<float>::min() && gmm[c]._weight > 0.f;
+				weight_sum += gmm[c]._weight;
+			}
+			if(valid && std::isfinite(weight_sum))
+			{
+				for(auto& c : gmm)
+					c._weight /= weight_sum;
+
+				// Keep the extrapolated GMM only if it does not decrease the log-likelihood
+				auto likelihood = workspace._likelihood;
+				auto log_likelihood = workspace._log_likelihood;
+				std::swap(workspace._sample_weights, workspace._previous_sample_weights);
+				auto extrapolated_confidence = em_expectation_step(samples, gmm, workspace);
+				if(std::isfinite(extrapolated_confidence) && extrapolated_confidence >= confidence)
+				{
+					confidence = extrapolated_confidence;
+					continue;
+				}
+				// Restore the membership weights of the second EM step, which the next maximization step needs
+				std::swap(workspace._sample_weights, workspace._previous_sample_weights);
+				workspace._likelihood = likelihood;
+				workspace._log_likelihood = log_likelihood;
+			}
+			std::copy(second, second + num_components, gmm.begin());
+		}
+		workspace._em_iterations += iterations;
+		return iterations;
+	}
+
+	void math_util::split_component(const GMMComponent* gmm, size_t num_components, GMMComponent* split)
+	{
+		Expects(num_components != 0);
+
+		auto widest = std::max_element(gmm, gmm + num_components, [] (const auto& a, const auto& b) { return a._weight * a._variance < b._weight * b._variance; });
+		std::copy(gmm, gmm + num_components, split);
+
+		// Two halves at mean -/+ offset * deviation. Each keeps (1 - offset^2) of the variance,
+		// the spread of the means makes up the rest.
+		auto offset = fit_gmm_split_offset * std::sqrt(widest->_variance);
+		auto variance = widest->_variance * (1.f - square(fit_gmm_split_offset));
+		auto weight = widest->_weight / 2;
+		split[widest - gmm] = {widest->_mean - offset, variance, weight};
+		split[num_components] = {widest->_mean + offset, variance, weight};
+	}
+
+	void math_util::constant_gmm(float value, unsigned max_components, std::vector<GMMComponent>& result)
+	{
+		result.assign(max_components, GMMComponent{0.f, 0.f, 0.f});
+		result.front() = {value, 0.f, 1.f};
+	}
 
 	std::vector<math_util::GMMComponent> math_util::fit_gmm(const std::vector<float>& samples, unsigned max_components)
+	{
+		auto workspace = GMMWorkspace{};
+		auto result = std::vector<GMMComponent>{};
+		fit_gmm(samples, max_components, workspace, result);
+		return result;
+	}
+
+	void math_util::fit_gmm(const std::vector<float>& samples, unsigned max_components, GMMWorkspace& workspace, std::vector<GMMComponent>& result)
+	{
+		fit_gmm(samples, max_components, {}, workspace, result);
+	}
+
+	void math_util::fit_gmm(const std::vector<float>& samples, unsigned max_components, const std::vector<GMMComponent>& seed,
+							GMMWorkspace& workspace, std::vector<GMMComponent>& result)
 	{
 		Expects(max_components != 0);
+		Expects(&seed != &result);
 
-		// Initialize with single gauss MLE
-		auto result = std::vector<GMMComponent>{{}};
-		result.push_back({});
-		result.front()._mean = mean(samples);
-		result.front()._variance = variance(samples, result.front()._mean);
+		// Without variance no component has a density, EM could only end up with the single gauss
+		if(samples.front() == samples.back())
+		{
+			constant_gmm(samples.front(), max_components, result);
+			return;
+		}
+
+		// Dispatch to the kernels specialized for the number of components
+		auto fit_fixed = [&] (auto components)
+		{
+			auto gmm = FixedGMM<decltype(components)::value>{};
+			fit_gmm(samples, seed, workspace, gmm);
+			result.assign(gmm.begin(), gmm.end());
+		};
+		switch(max_components)
+		{
+		case 2: fit_fixed(std::integral_constant<size_t, 2>{}); return;
+		case 3: fit_fixed(std::integral_constant<size_t, 3>{}); return;
+		case 4: fit_fixed(std::integral_constant<size_t, 4>{}); return;
+		case 5: fit_fixed(std::integral_constant<size_t, 5>{}); return;
+		case 6: fit_fixed(std::integral_constant<size_t, 6>{}); return;
+		case 7: fit_fixed(std::integral_constant<size_t, 7>{}); return;
+		case 8: fit_fixed(std::integral_constant<size_t, 8>{}); return;
+		default: break;
+		}
+
+		// Initialize with single gauss MLE. The moments also yield the variance around every initial mean.
+		const auto sample_moments = moments(samples);
+		result.assign(2, GMMComponent{});
+		result.front()._mean = sample_moments._mean;
+		result.front()._variance = sample_moments._variance;
 		result.front()._weight = 1.f;
 
 		auto min_aic = gmm_aic(samples, result, fit_gmm_component_penalty_factor);
 
-		// Try MLE GMMs with [2, max_components] components
+		// Warm start: If the seeds components, refined by EM, explain the samples better than a single gauss,
+		// the search continues above their number of components. Otherwise it starts from scratch.
+		unsigned first_k = 2;
+		auto seed_components = static_cast<unsigned>(std::count_if(seed.begin(), seed.end(), [] (const auto& c) { return c._weight != 0.f; }));
+		if(seed_components >= 2 && seed_components <= max_components)
+		{
+			auto& gmm = workspace._gmm;
+			gmm.clear();
+			std::copy_if(seed.begin(), seed.end(), std::back_inserter(gmm), [] (const auto& c) { return c._weight != 0.f; });
+
+			iterate_em(samples, gmm, workspace);
+			auto cur_aic = gmm_aic(workspace._likelihood, gmm.size(), fit_gmm_component_penalty_factor);
+			if(cur_aic < min_aic)
+			{
+				min_aic = cur_aic;
+				result.assign(gmm.begin(), gmm.end());
+				first_k = seed_components + 1;
+			}
+		}
+
+		// Try MLE GMMs with [first_k, max_components] components
 		// k = current number of components
-		for(unsigned k = 2; k <= max_components; ++k)
+		for(unsigned k = first_k; k <= max_components; ++k)
 		{
-			auto gmm = std::vector<GMMComponent>{};
-			gmm.reserve(k);
+			auto& gmm = workspace._gmm;
+			gmm.clear();
 
+			// Split the best GMM with one component less
+			if(workspace._split_search)
+			{
+				gmm.resize(k);
+				split_component(result.data(), k - 1, gmm.data());
+			}
 			// Try initializing randomly, choose best result
-			if(fit_gmm_random_init)
+			else if(workspace._random_init && samples.size() >= k)
 			{
+				auto& picks = workspace._picks;
+				auto& init = workspace._random_gmm;
+				picks.resize(k);
+				init.resize(k);
 				float max_likelihood = -std::numeric_limits<float>::infinity();
 				for(int t = 0; t < fit_gmm_random_init_tries; ++t)
 				{
-					auto init = std::vector<GMMComponent>{};
-					init.reserve(k);
-					for(auto& s : pick_randomly(samples, k))
-						init.push_back({s, variance(samples, s), 1.f/k});
+					pick_indices(samples.size(), k, workspace._random, picks.data());
+					for(unsigned c = 0; c < k; ++c)
+						init[c] = {samples[picks[c]], variance(sample_moments, samples[picks[c]]), 1.f/k};
 
-					auto cur_likelihood = gmm_likelihood(samples, init);
-					if(cur_likelihood > max_likelihood)
+					em_expectation_step(samples, init, workspace);
+					if(workspace._likelihood > max_likelihood)
 					{
-						max_likelihood = cur_likelihood;
+						max_likelihood = workspace._likelihood;
 						gmm = init;
 					}
 				}
@@ -151,35 +706,440 @@ namespace vis
 			else // Initialize using evenly spaced samples
 			{
 				for(unsigned s = 0; s < k; ++s)
-					gmm.push_back({samples[static_cast<size_t>(samples.size() / k * (s + .5f))], variance(samples, samples[static_cast<size_t>(samples.size() / k * (s + .5f))]), 1.f/k});
+					gmm.push_back({samples[static_cast<size_t>(samples.size() / k * (s + .5f))], variance(sample_moments, samples[static_cast<size_t>(samples.size() / k * (s + .5f))]), 1.f/k});
 			}
 
-			// Iterate until difference in log-likelihood <= epsilon
-			auto confidence = gmm_log_likelihood(samples, gmm);
-			for(unsigned j = 0; j < fit_gmm_max_iterations; ++j)
+			iterate_em(samples, gmm, workspace);
+
+			// If current model has lowest AIC (Akaike Information criterion), keep iterating
+			auto cur_aic = gmm_aic(workspace._likelihood, gmm.size(), fit_gmm_component_penalty_factor);
+			if(cur_aic < min_aic)
 			{
-				em_step(samples, gmm);
-				auto new_confidence = gmm_log_likelihood(samples, gmm);
-				if(std::abs(confidence - new_confidence) < fit_gmm_log_likelihood_epsilon)
+				auto marginal = workspace._split_search && cur_aic > min_aic - fit_gmm_split_min_aic_improvement;
+				min_aic = cur_aic;
+				result.assign(gmm.begin(), gmm.end());
+				if(marginal)
 					break;
-				confidence = new_confidence;
 			}
+			// If not, the previous model is assumed best
+			else
+				break;
+		}
 
-			// If current model has lowest AIC (Akaike Information criterion), keep iterating
-			auto cur_aic = gmm_aic(samples, gmm, fit_gmm_component_penalty_factor);
+		std::sort(result.begin(), result.end(), [] (const auto& a, const auto& b) { return a._mean < b._mean && a._weight != 0.f; });
+		result.resize(max_components);
+	}
+
+	template<size_t K>
+	void math_util::fit_gmm(const std::vector<float>& samples, const std::vector<GMMComponent>& seed, GMMWorkspace& workspace, FixedGMM<K>& result)
+	{
+		static_assert(K >= 2, "Fixed size GMMs need at least two components");
+
+		if(samples.front() == samples.back())
+		{
+			result.fill(GMMComponent{0.f, 0.f, 0.f});
+			result[0] = {samples.front(), 0.f, 1.f};
+			return;
+		}
+
+		// Initialize with single gauss MLE. Like in the dynamic fit_gmm, the result holds a second, empty component.
+		const auto sample_moments = moments(samples);
+		result.fill(GMMComponent{});
+		result[0]._mean = sample_moments._mean;
+		result[0]._variance = sample_moments._variance;
+		result[0]._weight = 1.f;
+		size_t result_size = 2;
+
+		auto single_likelihood = 0.f;
+		for(const auto& s : samples)
+			single_likelihood += normal_density(s, result[0]._mean, result[0]._variance);
+		auto min_aic = gmm_aic(single_likelihood, 2, fit_gmm_component_penalty_factor);
+
+		// Fits a candidate with k components, stored in an array of fixed size, and keeps it if its AIC is lower.
+		// Returns whether it was kept, marginal tells whether it improved the AIC only marginally.
+		auto marginal = false;
+		auto fit_candidate = [&] (auto components, bool from_seed)
+		{
+			constexpr size_t k = decltype(components)::value;
+			auto gmm = FixedGMM<k>{};
+
+			if(from_seed)
+				std::copy_if(seed.begin(), seed.end(), gmm.begin(), [] (const auto& c) { return c._weight != 0.f; });
+			// Split the best GMM with one component less
+			else if(workspace._split_search)
+				split_component(result.data(), k - 1, gmm.data());
+			// Try initializing randomly, choose best result
+			else if(workspace._random_init && samples.size() >= k)
+			{
+				float max_likelihood = -std::numeric_limits<float>::infinity();
+				for(int t = 0; t < fit_gmm_random_init_tries; ++t)
+				{
+					auto init = FixedGMM<k>{};
+					size_t picks[k];
+					pick_indices(samples.size(), k, workspace._random, picks);
+					for(unsigned c = 0; c < k; ++c)
+						init[c] = {samples[picks[c]], variance(sample_moments, samples[picks[c]]), 1.f/k};
+
+					em_expectation_step(samples, init, workspace);
+					if(workspace._likelihood > max_likelihood)
+					{
+						max_likelihood = workspace._likelihood;
+						gmm = init;
+					}
+				}
+			}
+			else // Initialize using evenly spaced samples
+			{
+				for(unsigned s = 0; s < k; ++s)
+					gmm[s] = {samples[static_cast<size_t>(samples.size() / k * (s + .5f))], variance(sample_moments, samples[static_cast<size_t>(samples.size() / k * (s + .5f))]), 1.f/k};
+			}
+
+			iterate_em(samples, gmm, workspace);
+
+			auto cur_aic = gmm_aic(workspace._likelihood, k, fit_gmm_component_penalty_factor);
 			if(cur_aic < min_aic)
 			{
+				marginal = workspace._split_search && cur_aic > min_aic - fit_gmm_split_min_aic_improvement;
 				min_aic = cur_aic;
-				result = gmm;
+				std::copy(gmm.begin(), gmm.end(), result.begin());
+				result_size = k;
+				return true;
+			}
+			return false;
+		};
+
+		// Warm start: If the seeds components, refined by EM, explain the samples better than a single gauss,
+		// the search continues above their number of components. Otherwise it starts from scratch.
+		unsigned first_k = 2;
+		auto seed_components = static_cast<unsigned>(std::count_if(seed.begin(), seed.end(), [] (const auto& c) { return c._weight != 0.f; }));
+		auto fit_seed = [&] (auto self, auto components) -> void
+		{
+			constexpr size_t k = decltype(components)::value;
+			if(k == seed_components)
+			{
+				if(fit_candidate(components, true))
+					first_k = k + 1;
+			}
+			else if constexpr (k < K)
+				self(self, std::integral_constant<size_t, k + 1>{});
+		};
+		if(seed_components >= 2 && seed_components <= K)
+			fit_seed(fit_seed, std::integral_constant<size_t, 2>{});
+
+		// Try MLE GMMs with [first_k, K] components, unrolled at compile time.
+		// If the current model has the lowest AIC (Akaike Information criterion) keep iterating,
+		// if not, the previous model is assumed best.
+		auto search = [&] (auto self, auto components) -> void
+		{
+			constexpr size_t k = decltype(components)::value;
+			if(k >= first_k && (!fit_candidate(components, false) || marginal))
+				return;
+			if constexpr (k < K)
+				self(self, std::integral_constant<size_t, k + 1>{});
+		};
+		search(search, std::integral_constant<size_t, 2>{});
+
+		std::sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(result_size), [] (const auto& a, const auto& b) { return a._mean < b._mean && a._weight != 0.f; });
+	}
+
+	void math_util::fit_gmm_binned(const std::vector<float>& samples, unsigned max_components, unsigned num_bins, const std::vector<GMMComponent>& seed,
+								   GMMWorkspace& workspace, std::vector<GMMComponent>& result)
+	{
+		Expects(max_components != 0);
+		Expects(&seed != &result);
+
+		// Binning only pays off if it reduces the number of densities evaluated per EM iteration
+		if(samples.size() <= num_bins || samples.front() == samples.back())
+		{
+			fit_gmm(samples, max_components, seed, workspace, result);
+			return;
+		}
+
+		auto& histogram = workspace._histogram;
+		bin_samples(samples, num_bins, histogram);
+
+		// Initialize with single gauss MLE
+		result.assign(2, GMMComponent{});
+		result.front()._mean = mean(histogram);
+		result.front()._variance = variance(histogram, result.front()._mean);
+		result.front()._weight = 1.f;
+
+		em_expectation_step(histogram, result, workspace);
+		auto min_aic = gmm_aic(workspace._likelihood, result.size(), fit_gmm_component_penalty_factor);
+
+		// Warm start, like in fit_gmm
+		unsigned first_k = 2;
+		auto seed_components = static_cast<unsigned>(std::count_if(seed.begin(), seed.end(), [] (const auto& c) { return c._weight != 0.f; }));
+		if(seed_components >= 2 && seed_components <= max_components)
+		{
+			auto& gmm = workspace._gmm;
+			gmm.clear();
+			std::copy_if(seed.begin(), seed.end(), std::back_inserter(gmm), [] (const auto& c) { return c._weight != 0.f; });
+
+			iterate_em(histogram, gmm, workspace);
+			auto cur_aic = gmm_aic(workspace._likelihood, gmm.size(), fit_gmm_component_penalty_factor);
+			if(cur_aic < min_aic)
+			{
+				min_aic = cur_aic;
+				result.assign(gmm.begin(), gmm.end());
+				first_k = seed_components + 1;
+			}
+		}
+
+		// Try MLE GMMs with [first_k, max_components] components, initialized at evenly spaced samples or by splitting
+		for(unsigned k = first_k; k <= max_components; ++k)
+		{
+			auto& gmm = workspace._gmm;
+			gmm.clear();
+			if(workspace._split_search)
+			{
+				gmm.resize(k);
+				split_component(result.data(), k - 1, gmm.data());
+			}
+			else
+			{
+				for(unsigned s = 0; s < k; ++s)
+				{
+					auto sample = samples[static_cast<size_t>(samples.size() / k * (s + .5f))];
+					gmm.push_back({sample, variance(histogram, sample), 1.f/k});
+				}
+			}
+
+			iterate_em(histogram, gmm, workspace);
+
+			auto cur_aic = gmm_aic(workspace._likelihood, gmm.size(), fit_gmm_component_penalty_factor);
+			if(cur_aic < min_aic)
+			{
+				auto marginal = workspace._split_search && cur_aic > min_aic - fit_gmm_split_min_aic_improvement;
+				min_aic = cur_aic;
+				result.assign(gmm.begin(), gmm.end());
+				if(marginal)
+					break;
 			}
-			// If not, the previous model is assumed best
 			else
 				break;
 		}
 
 		std::sort(result.begin(), result.end(), [] (const auto& a, const auto& b) { return a._mean < b._mean && a._weight != 0.f; });
 		result.resize(max_components);
-		return result;
+	}
+
+	void math_util::fit_gmm_batch(const std::vector<float>& samples, unsigned max_components, size_t num_points, GMMBatchWorkspace& workspace,
+								  std::vector<std::vector<GMMComponent>>& gmms)
+	{
+		using simd_util::Float;
+		using simd_util::broadcast;
+
+		Expects(max_components != 0);
+		Expects(num_points <= gmm_batch_size);
+		Expects(!samples.empty() && samples.size() % gmm_batch_size == 0);
+
+		const auto num_samples = samples.size() / gmm_batch_size;
+		if(gmms.size() < num_points)
+			gmms.resize(num_points);
+		const auto zero = broadcast(0.f);
+		const auto sample_count = broadcast(static_cast<float>(num_samples));
+
+		auto& xs = workspace._samples;
+		xs.resize(num_samples);
+		for(size_t s = 0; s < num_samples; ++s)
+			xs[s] = simd_util::load(&samples[s * gmm_batch_size]);
+
+		auto batch_variance = [&xs, &zero, &sample_count] (Float mean)
+		{
+			auto sum = zero;
+			for(const auto& x : xs)
+				sum = simd_util::mul_add(mean - x, mean - x, sum);
+			return sum / sample_count;
+		};
+
+		// Components are stored as structures of lanes
+		const auto num_slots = std::max(max_components, 2u);
+		auto& means = workspace._means;
+		auto& variances = workspace._variances;
+		auto& weights = workspace._weights;
+		auto& next_means = workspace._next_means;
+		auto& next_variances = workspace._next_variances;
+		auto& next_weights = workspace._next_weights;
+		auto& factors = workspace._factors;
+		auto& scales = workspace._scales;
+		for(auto buffer : {&means, &variances, &weights, &next_means, &next_variances, &next_weights, &factors, &scales})
+			buffer->assign(num_slots, zero);
+		auto& sample_weights = workspace._sample_weights;
+		sample_weights.resize(num_samples * num_slots);
+
+		// Prepares weight * factor * exp(scale * (x - mean)^2) for the weighted normal densities of k components
+		auto prepare_densities = [&] (unsigned k)
+		{
+			for(unsigned c = 0; c < k; ++c)
+			{
+				auto singular = variances[c] == zero;
+				factors[c] = simd_util::select(singular, zero, weights[c] / simd_util::sqrt(broadcast(2 * pi) * variances[c]));
+				scales[c] = simd_util::select(singular, zero, broadcast(-.5f) / variances[c]);
+			}
+		};
+
+		// Sums the GMM densities of the samples and their logarithms.
+		// The weighted component densities are kept in sample_weights, so the following E-step does not evaluate them again.
+		auto sum_densities = [&] (unsigned k, Float& likelihood, Float& log_likelihood)
+		{
+			prepare_densities(k);
+			workspace._density_evaluations += static_cast<long>(num_samples * k * gmm_batch_size);
+			likelihood = zero;
+			log_likelihood = zero;
+			for(size_t s = 0; s < num_samples; ++s)
+			{
+				auto density = zero;
+				for(unsigned c = 0; c < k; ++c)
+				{
+					auto deviation = xs[s] - means[c];
+					sample_weights[s * k + c] = factors[c] * simd_util::exp(scales[c] * deviation * deviation);
+					density = density + sample_weights[s * k + c];
+				}
+				likelihood = likelihood + density;
+				log_likelihood = log_likelihood + simd_util::log(density);
+			}
+		};
+
+		// Has to follow sum_densities for the current components
+		auto em_step = [&] (unsigned k)
+		{
+			// E-step
+			for(size_t s = 0; s < num_samples; ++s)
+			{
+				auto density = zero;
+				for(unsigned c = 0; c < k; ++c)
+					density = density + sample_weights[s * k + c];
+				auto inverse_density = broadcast(1.f) / density;
+				for(unsigned c = 0; c < k; ++c)
+					sample_weights[s * k + c] = sample_weights[s * k + c] * inverse_density;
+			}
+
+			// M-step
+			for(unsigned c = 0; c < k; ++c)
+			{
+				auto weight_sum = zero;
+				auto mean = zero;
+				for(size_t s = 0; s < num_samples; ++s)
+				{
+					weight_sum = weight_sum + sample_weights[s * k + c];
+					mean = simd_util::mul_add(sample_weights[s * k + c], xs[s], mean);
+				}
+				next_weights[c] = weight_sum / sample_count;
+				mean = mean / weight_sum;
+
+				auto variance = zero;
+				for(size_t s = 0; s < num_samples; ++s)
+					variance = simd_util::mul_add(sample_weights[s * k + c], (xs[s] - mean) * (xs[s] - mean), variance);
+				variance = variance / weight_sum;
+
+				// Avoid singularity, like em_step does without random initialization
+				auto singular = variance <= broadcast(std::numeric_limits<float>::min());
+				if(simd_util::any(singular))
+				{
+					mean = simd_util::select(singular, xs.front(), mean);
+					variance = simd_util::select(singular, batch_variance(xs.front()), variance);
+				}
+				next_means[c] = mean;
+				next_variances[c] = variance;
+			}
+		};
+
+		auto aic = [] (unsigned num_components, Float likelihood)
+		{
+			return broadcast(fit_gmm_component_penalty_factor * 2 * (num_components * 3 - 1)) - broadcast(2.f) * simd_util::log(likelihood);
+		};
+
+		// Initialize with single gauss MLE. Like in fit_gmm, the result holds a second, empty component.
+		means[0] = zero;
+		for(const auto& x : xs)
+			means[0] = means[0] + x;
+		means[0] = means[0] / sample_count;
+		variances[0] = batch_variance(means[0]);
+		weights[0] = broadcast(1.f);
+
+		auto likelihood = zero;
+		auto log_likelihood = zero;
+		sum_densities(2, likelihood, log_likelihood);
+		auto min_aic = aic(2, likelihood);
+
+		auto& result_means = workspace._result_means;
+		auto& result_variances = workspace._result_variances;
+		auto& result_weights = workspace._result_weights;
+		result_means.assign(means.begin(), means.end());
+		result_variances.assign(variances.begin(), variances.end());
+		result_weights.assign(weights.begin(), weights.end());
+		auto result_sizes = broadcast(2.f);
+
+		// Try MLE GMMs with [2, max_components] components while the AIC of a lane improves
+		auto active = simd_util::all_lanes();
+		for(unsigned k = 2; k <= max_components && simd_util::any(active); ++k)
+		{
+			// Initialize using evenly spaced samples
+			for(unsigned c = 0; c < k; ++c)
+			{
+				means[c] = xs[static_cast<size_t>(num_samples / k * (c + .5f))];
+				variances[c] = batch_variance(means[c]);
+				weights[c] = broadcast(1.f/k);
+			}
+
+			// Iterate until difference in log-likelihood <= epsilon
+			sum_densities(k, likelihood, log_likelihood);
+			auto confidence = log_likelihood;
+			auto iterating = active;
+			for(unsigned j = 0; j < fit_gmm_max_iterations && simd_util::any(iterating); ++j)
+			{
+				em_step(k);
+				for(unsigned c = 0; c < k; ++c)
+				{
+					means[c] = simd_util::select(iterating, next_means[c], means[c]);
+					variances[c] = simd_util::select(iterating, next_variances[c], variances[c]);
+					weights[c] = simd_util::select(iterating, next_weights[c], weights[c]);
+				}
+
+				auto new_likelihood = zero;
+				auto new_confidence = zero;
+				sum_densities(k, new_likelihood, new_confidence);
+				likelihood = simd_util::select(iterating, new_likelihood, likelihood);
+
+				auto converged = simd_util::abs(confidence - new_confidence) < broadcast(fit_gmm_log_likelihood_epsilon);
+				confidence = simd_util::select(iterating, new_confidence, confidence);
+				iterating = iterating & !converged;
+			}
+
+			// Lanes whose AIC (Akaike Information criterion) improved keep the model and keep iterating
+			auto cur_aic = aic(k, likelihood);
+			active = active & (cur_aic < min_aic);
+			min_aic = simd_util::select(active, cur_aic, min_aic);
+			result_sizes = simd_util::select(active, broadcast(static_cast<float>(k)), result_sizes);
+			for(unsigned c = 0; c < k; ++c)
+			{
+				result_means[c] = simd_util::select(active, means[c], result_means[c]);
+				result_variances[c] = simd_util::select(active, variances[c], result_variances[c]);
+				result_weights[c] = simd_util::select(active, weights[c], result_weights[c]);
+			}
+		}
+
+		// Scatter the lanes into GMMs, ordered like fit_gmm orders them
+		auto sizes = simd_util::to_array(result_sizes);
+		for(size_t l = 0; l < num_points; ++l)
+			gmms[l].clear();
+		for(unsigned c = 0; c < num_slots; ++c)
+		{
+			auto lane_means = simd_util::to_array(result_means[c]);
+			auto lane_variances = simd_util::to_array(result_variances[c]);
+			auto lane_weights = simd_util::to_array(result_weights[c]);
+			for(size_t l = 0; l < num_points; ++l)
+				if(c < sizes[l])
+					gmms[l].push_back({lane_means[l], lane_variances[l], lane_weights[l]});
+		}
+
+		for(size_t l = 0; l < num_points; ++l)
+		{
+			auto& gmm = gmms[l];
+			std::sort(gmm.begin(), gmm.end(), [] (const auto& a, const auto& b) { return a._mean < b._mean && a._weight != 0.f; });
+			gmm.resize(max_components);
+		}
 	}
 
 	float math_util::gmm_log_likelihood(const std::vector<float>& samples, const std::vector<GMMComponent>& gmm)
@@ -207,8 +1167,13 @@ namespace vis
 
 	float math_util::gmm_aic(const std::vector<float>& samples, const std::vector<GMMComponent>& gmm, float k_bias)
 	{
-		return k_bias * 2 * (gmm.size() * 3 - 1)                          // 2 * #free parameters   | 1D -> n free means, n free variances, n-1 free weights (n sum to 1) = 3n - 1
-				- 2 * std::log(gmm_likelihood(samples, gmm));   // - 2 * ln( likelihood )
+		return gmm_aic(gmm_likelihood(samples, gmm), gmm.size(), k_bias);
+	}
+
+	float math_util::gmm_aic(float likelihood, size_t num_components, float k_bias)
+	{
+		return k_bias * 2 * (num_components * 3 - 1)                      // 2 * #free parameters   | 1D -> n free means, n free variances, n-1 free weights (n sum to 1) = 3n - 1
+				- 2 * std::log(likelihood);                     // - 2 * ln( likelihood )
 	}
 
 	float math_util::gmm_aic_c(const std::vector<float>& samples, const std::vector<GMMComponent>& gmm, float k_bias)
@@ -307,17 +1272,40 @@ namespace vis
 
 	float math_util::pick_randomly(const std::vector<float>& samples)
 	{
-		auto re = std::default_random_engine{std::random_device{}()};
-		return samples[std::uniform_int_distribution<size_t>(0, samples.size()-1)(re)];
+		thread_local auto random = RandomEngine{fit_gmm_random_seed};
+		return pick_randomly(samples, random);
 	}
 
-	std::vector<float> math_util::pick_randomly(std::vector<float> samples, unsigned num_picks)
+	float math_util::pick_randomly(const std::vector<float>& samples, RandomEngine& random)
+	{
+		return samples[std::uniform_int_distribution<size_t>(0, samples.size()-1)(random)];
+	}
+
+	std::vector<float> math_util::pick_randomly(const std::vector<float>& samples, unsigned num_picks)
 	{
 		if(num_picks >= samples.size())
 			return {};
-		std::random_shuffle(samples.begin(), samples.end());
-		samples.resize(num_picks);
-		return samples;
+		thread_local auto random = RandomEngine{fit_gmm_random_seed};
+		auto indices = std::vector<size_t>(num_picks);
+		pick_indices(samples.size(), num_picks, random, indices.data());
+		auto picks = std::vector<float>(num_picks);
+		for(unsigned p = 0; p < num_picks; ++p)
+			picks[p] = samples[indices[p]];
+		return picks;
+	}
+
+	void math_util::pick_indices(size_t count, unsigned num_picks, RandomEngine& random, size_t* indices)
+	{
+		Expects(num_picks <= count);
+
+		// Floyd: For each of the last num_picks indices j, pick from [0, j]. If the pick was taken before, take j itself,
+		// which cannot have been picked yet. Every subset is equally likely.
+		for(unsigned p = 0; p < num_picks; ++p)
+		{
+			auto j = count - num_picks + p;
+			auto index = std::uniform_int_distribution<size_t>(0, j)(random);
+			indices[p] = std::find(indices, indices + p, index) == indices + p ? index : j;
+		}
 	}
 
 	std::tuple<float, float> math_util::round_interval(float lower_bound, float upper_bound)
@@ -423,4 +1411,28 @@ namespace vis
 		auto maxima = combined_maxima(mean_field, dev_field);
 		return *std::max_element(maxima.begin(), maxima.end());
 	}
+
+	// Explicit instantiations for dynamically sized GMMs and the specialized numbers of components
+#define VIS_MATH_UTIL_INSTANTIATE_EM(Components) \
+	template void math_util::em_step(const std::vector<float>&, Components&, GMMWorkspace&); \
+	template float math_util::em_expectation_step(const std::vector<float>&, const Components&, GMMWorkspace&); \
+	template void math_util::em_maximization_step(const std::vector<float>&, Components&, GMMWorkspace&); \
+	template unsigned math_util::iterate_em(const std::vector<float>&, Components&, GMMWorkspace&); \
+	template unsigned math_util::iterate_squarem(const std::vector<float>&, Components&, GMMWorkspace&);
+#define VIS_MATH_UTIL_INSTANTIATE_GMM(K) \
+	VIS_MATH_UTIL_INSTANTIATE_EM(math_util::FixedGMM<K>) \
+	template void math_util::fit_gmm(const std::vector<float>&, const std::vector<GMMComponent>&, GMMWorkspace&, FixedGMM<K>&);
+
+	VIS_MATH_UTIL_INSTANTIATE_EM(std::vector<math_util::GMMComponent>)
+	template unsigned math_util::iterate_squarem(const GMMHistogram&, std::vector<GMMComponent>&, GMMWorkspace&);
+	VIS_MATH_UTIL_INSTANTIATE_GMM(2)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(3)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(4)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(5)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(6)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(7)
+	VIS_MATH_UTIL_INSTANTIATE_GMM(8)
+
+#undef VIS_MATH_UTIL_INSTANTIATE_GMM
+#undef VIS_MATH_UTIL_INSTANTIATE_EM
 }
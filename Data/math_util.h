@@ -2,10 +2,14 @@
 #define MATH_UTIL_H
 
 #include <vector>
+#include <array>
 #include <tuple>
 #include <cmath>
+#include <random>
+#include <cstdint>
 
 #include "field.h"
+#include "simd_util.h"
 
 namespace vis
 {
@@ -16,11 +20,39 @@ namespace vis
 	{
 		constexpr float pi = static_cast<float>(M_PI);
 
+		/// Default of GMMWorkspace::_random_init.
 		static constexpr bool fit_gmm_random_init = false;
 		static constexpr int fit_gmm_random_init_tries = 25;
+		/// Seed of the random engines of the GMM fits, unless they are reseeded.
+		static constexpr std::uint32_t fit_gmm_random_seed = 5489u;
 		static constexpr int fit_gmm_max_iterations = 30;
 		static constexpr float fit_gmm_log_likelihood_epsilon = 0.1f;
 		static constexpr float fit_gmm_component_penalty_factor = 1.f;
+		/// Offset of the two halves of a split component from its mean, in standard deviations.
+		static constexpr float fit_gmm_split_offset = .5f;
+		/// The split search stops after a number of components whose AIC improved by less than this.
+		/// Differences below 2 are commonly not considered significant.
+		static constexpr float fit_gmm_split_min_aic_improvement = 2.f;
+		/// Number of points fitted at once by fit_gmm_batch, one for each SIMD lane.
+		static constexpr size_t gmm_batch_size = simd_util::lanes;
+
+		/// Random engine of the GMM fits. Its state is a single integer, so it is cheap to reseed for every fit.
+		using RandomEngine = std::minstd_rand;
+
+		/**
+		 * @brief random_seed Returns the seed of the random engine for one of many streams, for example the fit of one point.
+		 * Consecutive seeds start linear congruential engines with strongly correlated draws, so the stream index is
+		 * scrambled by the splitmix64 finalizer first.
+		 */
+		inline std::uint32_t random_seed(std::uint64_t stream)
+		{
+			auto z = stream + fit_gmm_random_seed + 0x9e3779b97f4a7c15ull;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			z ^= z >> 31;
+			// minstd_rand treats seeds modulo 2^31 - 1 and replaces 0 by 1
+			return static_cast<std::uint32_t>(z >> 33) + 1u;
+		}
 
 		struct GMMComponent
 		{
@@ -29,6 +61,119 @@ namespace vis
 			float _weight;
 		};
 
+		/// Components of a GMM with a number of components known at compile time.
+		template<size_t K>
+		using FixedGMM = std::array<GMMComponent, K>;
+		/// Numbers of components fit_gmm has specialized kernels for.
+		static constexpr size_t fit_gmm_min_fixed_components = 2;
+		static constexpr size_t fit_gmm_max_fixed_components = 8;
+		/// Number of histogram bins fit_gmm_binned uses by default.
+		static constexpr unsigned fit_gmm_default_bins = 64;
+
+		/**
+		 * @brief The RunningMoments struct holds the running mean and sum of squared deviations of samples for many points.
+		 */
+		struct RunningMoments
+		{
+			long _count{0};
+			std::vector<double> _mean{};
+			std::vector<double> _m2{};
+		};
+
+		/**
+		 * @brief The PrefixMoments struct holds cumulative sums and sums of squares of the samples of many points over time steps.
+		 * The sums over any window of time steps follow from the difference of two cumulative sums.
+		 * Samples are shifted by a value of each point before they are summed, so the sums of squares do not cancel for large values.
+		 */
+		struct PrefixMoments
+		{
+			size_t _num_steps{0};
+			long _members{0};				///< Number of samples of each point and time step.
+			std::vector<float> _shift{};	///< Value subtracted from every sample of a point.
+			std::vector<double> _sum{};		///< Sum of the samples of all time steps before s at [s * points + point], for s in [0, _num_steps].
+			std::vector<double> _square_sum{};
+		};
+
+		/**
+		 * @brief The Moments struct holds the mean and variance of samples. Their variance around any other mean follows in O(1).
+		 */
+		struct Moments
+		{
+			float _mean;
+			float _variance;
+		};
+
+		/**
+		 * @brief The GMMHistogram struct holds samples binned into equally wide bins. Only bins that contain samples are stored.
+		 */
+		struct GMMHistogram
+		{
+			/// Centers of the non-empty bins, in ascending order.
+			std::vector<float> _centers{};
+			/// Number of samples in each bin.
+			std::vector<float> _counts{};
+			float _bin_width{0.f};
+			size_t _num_samples{0};
+		};
+
+		/**
+		 * @brief The GMMWorkspace struct owns the scratch buffers of em_step and fit_gmm.
+		 * Reusing one workspace per thread keeps repeated fits free of heap allocations, once the buffers have grown.
+		 */
+		struct GMMWorkspace
+		{
+			std::vector<float> _sample_weights{};
+			std::vector<GMMComponent> _gmm{};
+			/// The GMMs before and after each of the two EM steps of an accelerated EM cycle.
+			std::vector<GMMComponent> _em_history{};
+			/// Membership weights of the last GMM, kept while an extrapolated GMM is evaluated.
+			std::vector<float> _previous_sample_weights{};
+			/// The binned samples of fit_gmm_binned.
+			GMMHistogram _histogram{};
+			/// Likelihood and log-likelihood of the GMM passed to the last em_expectation_step.
+			float _likelihood{0.f};
+			float _log_likelihood{0.f};
+			/// Number of component densities evaluated through this workspace.
+			long _density_evaluations{0};
+			/// Number of EM iterations run by iterate_em through this workspace. Accelerated EM counts every maximization step.
+			long _em_iterations{0};
+			/// Selects whether iterate_em runs accelerated EM (see iterate_squarem) instead of plain EM steps.
+			bool _accelerated_em{false};
+			/// Selects whether the fits initialize each number of components at the best of fit_gmm_random_init_tries random picks
+			/// of samples, instead of evenly spaced samples. Components collapsing to a single sample are also reset to a random sample.
+			bool _random_init{fit_gmm_random_init};
+			/// The random engine of the fits that use this workspace. Reseeding it before each fit makes random fits reproducible.
+			RandomEngine _random{fit_gmm_random_seed};
+			/// Indices of randomly picked samples and the best random initialization found so far.
+			std::vector<size_t> _picks{};
+			std::vector<GMMComponent> _random_gmm{};
+			/// Selects whether the fits initialize each number of components by splitting the best GMM with one component less
+			/// (see split_component) instead of evenly spaced samples, and stop once the AIC improves marginally.
+			bool _split_search{false};
+		};
+
+		/**
+		 * @brief The GMMBatchWorkspace struct owns the scratch buffers of fit_gmm_batch.
+		 */
+		struct GMMBatchWorkspace
+		{
+			std::vector<simd_util::Float> _samples{};
+			std::vector<simd_util::Float> _sample_weights{};
+			std::vector<simd_util::Float> _means{};
+			std::vector<simd_util::Float> _variances{};
+			std::vector<simd_util::Float> _weights{};
+			std::vector<simd_util::Float> _next_means{};
+			std::vector<simd_util::Float> _next_variances{};
+			std::vector<simd_util::Float> _next_weights{};
+			std::vector<simd_util::Float> _factors{};
+			std::vector<simd_util::Float> _scales{};
+			std::vector<simd_util::Float> _result_means{};
+			std::vector<simd_util::Float> _result_variances{};
+			std::vector<simd_util::Float> _result_weights{};
+			/// Number of component densities evaluated through this workspace, counted for each lane.
+			long _density_evaluations{0};
+		};
+
 		/**
 		 * @brief square Squares a float.
 		 */
@@ -76,6 +221,98 @@ namespace vis
 		 */
 		float variance(const std::vector<float>& samples, float mean);
 
+		/**
+		 * @brief moments Calculates the mean and the MLE for gaussian variance of samples in a single, vectorized pass.
+		 * The samples are shifted by the first one, so the squared deviations do not cancel for data far away from zero.
+		 * Every lane accumulates compensated (Kahan) sums, the lanes and the remaining samples are combined in double precision.
+		 * @param samples The sample data.
+		 * @param count The number of samples, must not be 0.
+		 */
+		Moments moments(const float* samples, size_t count);
+
+		/**
+		 * @brief moments Calculates the mean and variance of a collection of samples in a single pass.
+		 */
+		inline Moments moments(const std::vector<float>& samples) { return moments(samples.data(), samples.size()); }
+
+		/**
+		 * @brief variance Calculates the average of squared deviations of samples from mean, using their moments.
+		 */
+		inline float variance(const Moments& moments, float mean) { return moments._variance + square(moments._mean - mean); }
+
+		/**
+		 * @brief mean Calculates the average of binned samples, each located at the center of its bin.
+		 */
+		float mean(const GMMHistogram& histogram);
+
+		/**
+		 * @brief variance Calculates the average of squared deviations of binned samples from mean.
+		 * Includes Sheppard's correction (bin width squared / 12) for the spread of the samples inside of their bins.
+		 */
+		float variance(const GMMHistogram& histogram, float mean);
+
+		/**
+		 * @brief bin_samples Counts samples in num_bins equally wide bins spanning the range of the samples.
+		 * @param samples The sample data.
+		 * @param num_bins The number of bins.
+		 * @param histogram Receives the non-empty bins. Its capacity is reused.
+		 */
+		void bin_samples(const std::vector<float>& samples, unsigned num_bins, GMMHistogram& histogram);
+
+		/**
+		 * @brief welford_update Adds one sample for each point to running moments (Welford's algorithm).
+		 * @param moments The running moments. Empty moments are sized to the number of points.
+		 * @param samples One sample for each point.
+		 */
+		void welford_update(RunningMoments& moments, const std::vector<float>& samples);
+
+		/**
+		 * @brief welford_update Adds one sample of each member for the points in [begin, end) to running moments, in member order.
+		 * Leaves moments._count unchanged, so disjoint ranges of points can be updated concurrently.
+		 * Once all points are updated, moments._count has to be increased by the number of members.
+		 * @param moments The running moments, sized to the number of points.
+		 * @param members One sample for each point of each member.
+		 */
+		void welford_update(RunningMoments& moments, const std::vector<const float*>& members, size_t begin, size_t end);
+
+		/**
+		 * @brief welford_merge Combines two sets of running moments of the same points (Chan et al.).
+		 * @param moments The running moments that receive the combination.
+		 * @param other The running moments that are added.
+		 */
+		void welford_merge(RunningMoments& moments, const RunningMoments& other);
+
+		/**
+		 * @brief welford_remove Removes running moments of a subset of the samples from the running moments of all of them.
+		 * The inverse of welford_merge, so a window of samples can slide without summing the samples it keeps again.
+		 * @param moments The running moments of all samples, which receive the moments of the remaining samples.
+		 * @param other The running moments of the removed samples. Must be fewer than all samples.
+		 */
+		void welford_remove(RunningMoments& moments, const RunningMoments& other);
+
+		/**
+		 * @brief prefix_moments_reset Sizes prefix moments for time steps with members samples each and clears their sums.
+		 * @param shift One value for each point that is subtracted from its samples, for example the samples of the first member.
+		 */
+		void prefix_moments_reset(PrefixMoments& moments, size_t num_steps, long members, const std::vector<float>& shift);
+
+		/**
+		 * @brief prefix_moments_add Adds the samples of one member of a time step. Safe to be called concurrently for different steps.
+		 * @param samples One sample for each point.
+		 */
+		void prefix_moments_add(PrefixMoments& moments, size_t step, const std::vector<float>& samples);
+
+		/**
+		 * @brief prefix_moments_accumulate Turns the sums of each time step into cumulative sums, after all members were added.
+		 */
+		void prefix_moments_accumulate(PrefixMoments& moments);
+
+		/**
+		 * @brief prefix_moments_window Returns the mean and variance of the samples of a point in count time steps, stride steps apart.
+		 * Contiguous windows cost two differences of cumulative sums, strided windows one per time step.
+		 */
+		Moments prefix_moments_window(const PrefixMoments& moments, size_t point, size_t first_step, size_t count, size_t stride);
+
 		/**
 		 * @brief em_step Executes one step of the "Expectation Maximization" algorithm on a GMM using sample data.
 		 * @param samples The sample data.
@@ -83,6 +320,112 @@ namespace vis
 		 */
 		void em_step(const std::vector<float>& samples, std::vector<GMMComponent>& gmm);
 
+		/**
+		 * @brief em_step Executes one step of the "Expectation Maximization" algorithm using the buffers of a workspace.
+		 * The EM functions taking a workspace are instantiated for std::vector<GMMComponent> and for FixedGMM<K> with K in
+		 * [fit_gmm_min_fixed_components, fit_gmm_max_fixed_components]. Fixed GMMs let the compiler unroll the component loops.
+		 * @param samples The sample data.
+		 * @param components The GMMs components.
+		 * @param workspace The scratch buffers.
+		 */
+		template<typename Components>
+		void em_step(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief em_expectation_step Computes the membership weights of all samples in one sweep over the samples.
+		 * Every component density is evaluated once per sample. The same densities yield the likelihood and
+		 * log-likelihood of the GMM, which are stored in the workspace.
+		 * @param samples The sample data.
+		 * @param gmm The GMMs components.
+		 * @param workspace Receives the membership weights, the likelihood and the log-likelihood.
+		 * @return The log-likelihood of the GMM generating the samples.
+		 */
+		template<typename Components>
+		float em_expectation_step(const std::vector<float>& samples, const Components& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief em_maximization_step Updates the GMMs components from the membership weights of the preceding em_expectation_step.
+		 * @param samples The sample data.
+		 * @param gmm The GMMs components.
+		 * @param workspace The membership weights.
+		 */
+		template<typename Components>
+		void em_maximization_step(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief iterate_em Refines a GMM by EM steps until the log-likelihood changes by less than fit_gmm_log_likelihood_epsilon
+		 * or fit_gmm_max_iterations steps were executed.
+		 * Afterwards the workspace holds the likelihood and log-likelihood of the refined GMM.
+		 * If the workspace selects accelerated EM, iterate_squarem is run instead.
+		 * @param samples The sample data.
+		 * @param gmm The initialized GMMs components.
+		 * @param workspace The scratch buffers.
+		 * @return The number of EM steps executed.
+		 */
+		template<typename Components>
+		unsigned iterate_em(const std::vector<float>& samples, Components& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief em_expectation_step Computes the membership weights of all bins of a histogram. Every bin stands for as many
+		 * samples located at its center as it holds, so the likelihoods equal those of the unbinned functions for these samples.
+		 * @param histogram The binned sample data.
+		 * @param gmm The GMMs components.
+		 * @param workspace Receives the membership weights, the likelihood and the log-likelihood.
+		 * @return The log-likelihood of the GMM generating the binned samples.
+		 */
+		float em_expectation_step(const GMMHistogram& histogram, const std::vector<GMMComponent>& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief em_maximization_step Updates the GMMs components from the membership weights of the bins, weighted by their counts.
+		 * The variances include Sheppard's correction for the bin width.
+		 * @param histogram The binned sample data.
+		 * @param gmm The GMMs components.
+		 * @param workspace The membership weights.
+		 */
+		void em_maximization_step(const GMMHistogram& histogram, std::vector<GMMComponent>& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief iterate_em Refines a GMM by EM steps on binned samples, using the same stopping criteria as for unbinned samples.
+		 * @param histogram The binned sample data.
+		 * @param gmm The initialized GMMs components.
+		 * @param workspace The scratch buffers.
+		 * @return The number of EM steps executed.
+		 */
+		unsigned iterate_em(const GMMHistogram& histogram, std::vector<GMMComponent>& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief iterate_squarem Refines a GMM by EM, accelerated by squared extrapolation (SQUAREM, Varadhan and Roland).
+		 * Each cycle runs two EM steps and extrapolates the GMM along the change of its parameters. The extrapolated GMM is
+		 * only kept if it is valid and its log-likelihood is not below that of the second EM step, so the log-likelihood never decreases.
+		 * Poorly separated modes, where plain EM crawls, converge in far fewer EM steps. Stops like iterate_em.
+		 * Instantiated for the same samples and components as the EM steps.
+		 * @param samples The sample data, either unbinned samples or a GMMHistogram.
+		 * @param gmm The initialized GMMs components.
+		 * @param workspace The scratch buffers.
+		 * @return The number of EM steps executed.
+		 */
+		template<typename Samples, typename Components>
+		unsigned iterate_squarem(const Samples& samples, Components& gmm, GMMWorkspace& workspace);
+
+		/**
+		 * @brief split_component Derives the start of a GMM with one more component from a fitted GMM.
+		 * The component that contributes most to the variance (weight * variance) is replaced by two halves, which are offset from its
+		 * mean by fit_gmm_split_offset deviations in both directions. Their variances are reduced, so the mixture keeps its variance.
+		 * @param gmm The components of the fitted GMM.
+		 * @param num_components The number of components of the fitted GMM.
+		 * @param split Receives num_components + 1 components.
+		 */
+		void split_component(const GMMComponent* gmm, size_t num_components, GMMComponent* split);
+
+		/**
+		 * @brief constant_gmm Returns the GMM fitted to samples that all equal value: a single component at value without variance.
+		 * The remaining components have zero weight. Masked points are detected by this pattern with value 0.
+		 * @param value The value of the samples.
+		 * @param max_components The number of components the GMM will have.
+		 * @param result Receives the components. Its capacity is reused.
+		 */
+		void constant_gmm(float value, unsigned max_components, std::vector<GMMComponent>& result);
+
 		/**
 		 * @brief fit_gmm Attempts to fit a gaussian mixture model with n components to the sample data by using the EM algorithm.
 		 * Stops after max_iterations or when the loglikelihood does not change by more than epsilon between iterations.
@@ -94,6 +437,74 @@ namespace vis
 		 */
 		std::vector<GMMComponent> fit_gmm(const std::vector<float>& samples, unsigned max_components);
 
+		/**
+		 * @brief fit_gmm Fits a gaussian mixture model like fit_gmm above, using the buffers of a workspace.
+		 * Constant samples are answered by constant_gmm without running EM.
+		 * @param samples The sample data.
+		 * @param max_components The number of components the GMM will have.
+		 * @param workspace The scratch buffers. Must not be shared between threads.
+		 * @param result Receives the components. Its capacity is reused.
+		 */
+		void fit_gmm(const std::vector<float>& samples, unsigned max_components, GMMWorkspace& workspace, std::vector<GMMComponent>& result);
+
+		/**
+		 * @brief fit_gmm Fits a gaussian mixture model, starting from the components of a GMM fitted to similar samples (warm start).
+		 * The components of seed with non-zero weight are refined by EM first. If the result has a lower AIC than a single gauss,
+		 * only larger numbers of components are tried afterwards, otherwise the search runs like in fit_gmm without seed.
+		 * If the workspace selects the split search, every number of components starts from the best GMM with one component less.
+		 * @param samples The sample data.
+		 * @param max_components The number of components the GMM will have.
+		 * @param seed The GMM the fit starts from, for example the result of a neighbouring point. If empty, no warm start is done.
+		 * @param workspace The scratch buffers. Must not be shared between threads.
+		 * @param result Receives the components. Must not be seed.
+		 * Numbers of components in [fit_gmm_min_fixed_components, fit_gmm_max_fixed_components] are dispatched to fit_gmm<K>.
+		 */
+		void fit_gmm(const std::vector<float>& samples, unsigned max_components, const std::vector<GMMComponent>& seed,
+					 GMMWorkspace& workspace, std::vector<GMMComponent>& result);
+
+		/**
+		 * @brief fit_gmm Fits a gaussian mixture model with at most K components, like the dynamically sized fit_gmm.
+		 * Every candidate number of components is fitted in a FixedGMM, so each gets its own unrolled EM kernel.
+		 * Instantiated for K in [fit_gmm_min_fixed_components, fit_gmm_max_fixed_components].
+		 * @param samples The sorted sample data.
+		 * @param seed The GMM the fit starts from. If empty, no warm start is done.
+		 * @param workspace The scratch buffers. Must not be shared between threads.
+		 * @param result Receives the components, unused components have zero weight.
+		 */
+		template<size_t K>
+		void fit_gmm(const std::vector<float>& samples, const std::vector<GMMComponent>& seed, GMMWorkspace& workspace, FixedGMM<K>& result);
+
+		/**
+		 * @brief fit_gmm_binned Fits a gaussian mixture model like fit_gmm, but runs EM on a histogram of the samples.
+		 * The samples are binned once, afterwards each EM iteration costs O(num_bins * components) regardless of the number of samples.
+		 * Samples are located at the center of their bin, so means and deviations are only accurate up to a fraction of the bin width.
+		 * If there are no more samples than bins, or all samples are equal, the exact fit_gmm is used.
+		 * @param samples The sorted sample data.
+		 * @param max_components The number of components the GMM will have.
+		 * @param num_bins The number of histogram bins spanning the range of the samples.
+		 * @param seed The GMM the fit starts from. If empty, no warm start is done.
+		 * @param workspace The scratch buffers. Must not be shared between threads.
+		 * @param result Receives the components. Must not be seed.
+		 */
+		void fit_gmm_binned(const std::vector<float>& samples, unsigned max_components, unsigned num_bins, const std::vector<GMMComponent>& seed,
+							GMMWorkspace& workspace, std::vector<GMMComponent>& result);
+
+		/**
+		 * @brief fit_gmm_batch Fits gaussian mixture models to the samples of gmm_batch_size points at once.
+		 * Every point occupies one SIMD lane and runs the same steps as fit_gmm, lanes that finished are masked out.
+		 * Densities are evaluated with polynomial approximations of exp and log, so the components may differ
+		 * from fit_gmm within float precision.
+		 * @param samples The sorted samples of each point, interleaved: sample s of lane l is stored at s*gmm_batch_size + l.
+		 * Lanes past num_points have to hold samples as well, for example copies of another lane.
+		 * @param max_components The number of components each GMM will have.
+		 * @param num_points The number of lanes whose GMMs are returned.
+		 * @param workspace The scratch buffers. Must not be shared between threads.
+		 * @param gmms Its first num_points entries receive the GMMs of the first lanes, as fit_gmm would return them.
+		 * Their capacity is reused.
+		 */
+		void fit_gmm_batch(const std::vector<float>& samples, unsigned max_components, size_t num_points, GMMBatchWorkspace& workspace,
+						   std::vector<std::vector<GMMComponent>>& gmms);
+
 		/**
 		 * @brief gmm_log_likelyhood Calculates the log-likelihood of a given GMM at generating given samples.
 		 * @param samples The sample data.
@@ -128,6 +539,15 @@ namespace vis
 		 */
 		float gmm_aic(const std::vector<float>& samples, const std::vector<GMMComponent>& gmm, float k_bias = 1.f);
 
+		/**
+		 * @brief gmm_aic Calculates the Akaike information criterion of a gmm from its already known likelihood.
+		 * @param likelihood The likelihood of the GMM generating the samples.
+		 * @param num_components The number of components of the GMM.
+		 * @param k_bias Gets multiplied to the #parameter penalty.
+		 * @return The GMMs AIC
+		 */
+		float gmm_aic(float likelihood, size_t num_components, float k_bias = 1.f);
+
 		/**
 		 * @brief gmm_aic_c Calculates the corrected Akaike information criterion of a gmm for samples.
 		 * @param samples The samples.
@@ -150,19 +570,38 @@ namespace vis
 
 		/**
 		 * @brief pick_randomly Picks a random float from a collection of possible values.
+		 * Uses a random engine of the calling thread, seeded with fit_gmm_random_seed.
 		 * @param samples Collection of possible values.
 		 * @return The random float.
 		 */
 		float pick_randomly(const std::vector<float>& samples);
 
+		/**
+		 * @brief pick_randomly Picks a random float from a collection of possible values.
+		 * @param samples Collection of possible values.
+		 * @param random The random engine.
+		 * @return The random float.
+		 */
+		float pick_randomly(const std::vector<float>& samples, RandomEngine& random);
+
 		/**
 		 * @brief pick_randomly Picks a collection of random floats from a collection of possible values.
-		 * No multiple picks of the same indices.
+		 * No multiple picks of the same indices. Uses a random engine of the calling thread, seeded with fit_gmm_random_seed.
 		 * @param samples Collection of possible values.
 		 * @param num_picks Number of picks.
-		 * @return The collection that contains all picks.
+		 * @return The collection that contains all picks. Empty, if num_picks is not smaller than the number of samples.
+		 */
+		std::vector<float> pick_randomly(const std::vector<float>& samples, unsigned num_picks);
+
+		/**
+		 * @brief pick_indices Picks distinct random indices, for sampling without replacement.
+		 * Uses Floyd's algorithm, which needs num_picks random numbers, O(num_picks^2) comparisons and no allocations.
+		 * @param count The number of indices to pick from, [0, count).
+		 * @param num_picks Number of picks. Must not be larger than count.
+		 * @param random The random engine.
+		 * @param indices Receives num_picks distinct indices.
 		 */
-		std::vector<float> pick_randomly(std::vector<float> samples, unsigned num_picks);
+		void pick_indices(size_t count, unsigned num_picks, RandomEngine& random, size_t* indices);
 
 		std::tuple<float, float> round_interval(float lower_bound, float upper_bound);
 
@@ -0,0 +1,57 @@
+#include "sample_matrix.h"
+
+#include <algorithm>
+
+#include "logger.h"
+
+namespace vis
+{
+	SampleMatrix::SampleMatrix(int num_points, int num_samples)
+		: _num_points{num_points},
+		  _num_samples{num_samples}
+	{
+		if(_num_points < 0 || _num_samples < 0)
+		{
+			Logger::error() << "Sample matrix created with negative dimensions\n"
+							<< "points: " << num_points
+							<< " samples: " << num_samples;
+			throw std::length_error("Negative dimensions for sample matrix creation");
+		}
+		_data.resize(static_cast<size_t>(_num_points) * static_cast<size_t>(_num_samples));
+	}
+
+	int SampleMatrix::num_points() const		{ return _num_points; }
+
+	int SampleMatrix::num_samples() const		{ return _num_samples; }
+
+	const float* SampleMatrix::samples(int i) const
+	{
+		return _data.data() + static_cast<size_t>(i) * static_cast<size_t>(_num_samples);
+	}
+
+	void SampleMatrix::set_samples(int first_sample, const Field* begin, const Field* end)
+	{
+		constexpr int block_size = 256;
+
+		auto count = static_cast<int>(end - begin);
+		if(first_sample < 0 || first_sample + count > _num_samples
+				|| std::any_of(begin, end, [this] (const Field& f) { return f.volume() != _num_points || f.point_dimension() != 1 || !f.initialized(); }))
+		{
+			Logger::error() << "Samples " << first_sample << " to " << first_sample + count
+							<< " do not fit into sample matrix of " << _num_points << " points and " << _num_samples << " samples.";
+			throw std::length_error("Sample matrix access out of range.");
+		}
+
+		for(int block = 0; block < _num_points; block += block_size)
+		{
+			auto block_end = std::min(block + block_size, _num_points);
+			for(int m = 0; m < count; ++m)
+			{
+				const auto* values = begin[m].data().data();
+				auto* column = _data.data() + first_sample + m;
+				for(int i = block; i < block_end; ++i)
+					column[static_cast<size_t>(i) * static_cast<size_t>(_num_samples)] = values[i];
+			}
+		}
+	}
+}
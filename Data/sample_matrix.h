@@ -0,0 +1,50 @@
+#ifndef SAMPLE_MATRIX_H
+#define SAMPLE_MATRIX_H
+
+#include <vector>
+
+#include "field.h"
+
+namespace vis
+{
+	/**
+	 * @brief The SampleMatrix class stores the ensemble samples of many points point-major.
+	 * All samples of one point are contiguous, so per-point analyses stream through memory
+	 * instead of gathering one value from each member field.
+	 */
+	class SampleMatrix
+	{
+	public:
+		/**
+		 * @brief SampleMatrix Creates a zero initialized matrix.
+		 * @param num_points The number of points.
+		 * @param num_samples The number of samples for each point.
+		 */
+		explicit SampleMatrix(int num_points, int num_samples);
+
+		/// @brief Returns the number of points.
+		int num_points() const;
+		/// @brief Returns the number of samples of each point.
+		int num_samples() const;
+
+		/// @brief samples Returns a pointer to the num_samples() contiguous samples of the i-th point.
+		const float* samples(int i) const;
+
+		/**
+		 * @brief set_samples Transposes the values of consecutive member fields into the matrix.
+		 * The points are processed in blocks, so every block of the matrix is written contiguously.
+		 * @param first_sample The sample index that the first member provides.
+		 * @param begin The first member. Each member holds one value for each point.
+		 * @param end Past the last member.
+		 */
+		void set_samples(int first_sample, const Field* begin, const Field* end);
+
+	private:
+		int _num_points{};
+		int _num_samples{};
+
+		std::vector<float> _data{};
+	};
+}
+
+#endif // SAMPLE_MATRIX_H
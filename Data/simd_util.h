@@ -0,0 +1,275 @@
+#ifndef SIMD_UTIL_H
+#define SIMD_UTIL_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+// GCC warns inside of its own AVX-512 headers, whose _mm512_undefined_* placeholders are uninitialized on purpose
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+namespace vis
+{
+	/**
+	 * Lane types for computations that process several independent values at once.
+	 * The widest instruction set the compiler targets is used: AVX-512 (16 lanes), AVX2 with FMA (8 lanes)
+	 * or a plain 8 lane fallback that the compiler may vectorize on its own.
+	 */
+	namespace simd_util
+	{
+#if defined(__AVX512F__)
+		static constexpr size_t lanes = 16;
+		static constexpr bool vectorized = true;
+
+		struct Float { __m512 _v; };
+		struct Mask { __mmask16 _m; };
+
+		inline Float broadcast(float x)					{ return {_mm512_set1_ps(x)}; }
+		inline Float load(const float* p)				{ return {_mm512_loadu_ps(p)}; }
+		inline void store(float* p, Float a)			{ _mm512_storeu_ps(p, a._v); }
+
+		inline Float operator+(Float a, Float b)		{ return {_mm512_add_ps(a._v, b._v)}; }
+		inline Float operator-(Float a, Float b)		{ return {_mm512_sub_ps(a._v, b._v)}; }
+		inline Float operator*(Float a, Float b)		{ return {_mm512_mul_ps(a._v, b._v)}; }
+		inline Float operator/(Float a, Float b)		{ return {_mm512_div_ps(a._v, b._v)}; }
+		/// @brief Returns a*b + c.
+		inline Float mul_add(Float a, Float b, Float c)	{ return {_mm512_fmadd_ps(a._v, b._v, c._v)}; }
+		inline Float min(Float a, Float b)				{ return {_mm512_min_ps(a._v, b._v)}; }
+		inline Float max(Float a, Float b)				{ return {_mm512_max_ps(a._v, b._v)}; }
+		inline Float sqrt(Float a)						{ return {_mm512_sqrt_ps(a._v)}; }
+		inline Float abs(Float a)						{ return {_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a._v), _mm512_set1_epi32(0x7fffffff)))}; }
+		inline Float round(Float a)						{ return {_mm512_roundscale_ps(a._v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)}; }
+
+		inline Mask operator<(Float a, Float b)			{ return {_mm512_cmp_ps_mask(a._v, b._v, _CMP_LT_OQ)}; }
+		inline Mask operator<=(Float a, Float b)		{ return {_mm512_cmp_ps_mask(a._v, b._v, _CMP_LE_OQ)}; }
+		inline Mask operator==(Float a, Float b)		{ return {_mm512_cmp_ps_mask(a._v, b._v, _CMP_EQ_OQ)}; }
+		inline Mask operator&(Mask a, Mask b)			{ return {static_cast<__mmask16>(a._m & b._m)}; }
+		inline Mask operator|(Mask a, Mask b)			{ return {static_cast<__mmask16>(a._m | b._m)}; }
+		inline Mask operator!(Mask a)					{ return {static_cast<__mmask16>(~a._m)}; }
+		inline Mask all_lanes()							{ return {static_cast<__mmask16>(0xffff)}; }
+		inline bool any(Mask a)							{ return a._m != 0; }
+		/// @brief Returns a where the mask is set, b elsewhere.
+		inline Float select(Mask m, Float a, Float b)	{ return {_mm512_mask_blend_ps(m._m, b._v, a._v)}; }
+
+		/// @brief Returns 2^n for integral n in [-126, 127].
+		inline Float pow2(Float n)
+		{
+			return {_mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n._v), _mm512_set1_epi32(127)), 23))};
+		}
+		/// @brief Splits normalized positive a into a mantissa in [0.5, 1), which is returned, and an exponent.
+		inline Float frexp(Float a, Float& exponent)
+		{
+			auto bits = _mm512_castps_si512(a._v);
+			exponent._v = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+			return {_mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)))};
+		}
+#elif defined(__AVX2__)
+		static constexpr size_t lanes = 8;
+		static constexpr bool vectorized = true;
+
+		struct Float { __m256 _v; };
+		struct Mask { __m256 _m; };
+
+		inline Float broadcast(float x)					{ return {_mm256_set1_ps(x)}; }
+		inline Float load(const float* p)				{ return {_mm256_loadu_ps(p)}; }
+		inline void store(float* p, Float a)			{ _mm256_storeu_ps(p, a._v); }
+
+		inline Float operator+(Float a, Float b)		{ return {_mm256_add_ps(a._v, b._v)}; }
+		inline Float operator-(Float a, Float b)		{ return {_mm256_sub_ps(a._v, b._v)}; }
+		inline Float operator*(Float a, Float b)		{ return {_mm256_mul_ps(a._v, b._v)}; }
+		inline Float operator/(Float a, Float b)		{ return {_mm256_div_ps(a._v, b._v)}; }
+		/// @brief Returns a*b + c.
+#if defined(__FMA__)
+		inline Float mul_add(Float a, Float b, Float c)	{ return {_mm256_fmadd_ps(a._v, b._v, c._v)}; }
+#else
+		inline Float mul_add(Float a, Float b, Float c)	{ return {_mm256_add_ps(_mm256_mul_ps(a._v, b._v), c._v)}; }
+#endif
+		inline Float min(Float a, Float b)				{ return {_mm256_min_ps(a._v, b._v)}; }
+		inline Float max(Float a, Float b)				{ return {_mm256_max_ps(a._v, b._v)}; }
+		inline Float sqrt(Float a)						{ return {_mm256_sqrt_ps(a._v)}; }
+		inline Float abs(Float a)						{ return {_mm256_andnot_ps(_mm256_set1_ps(-0.f), a._v)}; }
+		inline Float round(Float a)						{ return {_mm256_round_ps(a._v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)}; }
+
+		inline Mask operator<(Float a, Float b)			{ return {_mm256_cmp_ps(a._v, b._v, _CMP_LT_OQ)}; }
+		inline Mask operator<=(Float a, Float b)		{ return {_mm256_cmp_ps(a._v, b._v, _CMP_LE_OQ)}; }
+		inline Mask operator==(Float a, Float b)		{ return {_mm256_cmp_ps(a._v, b._v, _CMP_EQ_OQ)}; }
+		inline Mask operator&(Mask a, Mask b)			{ return {_mm256_and_ps(a._m, b._m)}; }
+		inline Mask operator|(Mask a, Mask b)			{ return {_mm256_or_ps(a._m, b._m)}; }
+		inline Mask operator!(Mask a)					{ return {_mm256_xor_ps(a._m, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+		inline Mask all_lanes()							{ return {_mm256_castsi256_ps(_mm256_set1_epi32(-1))}; }
+		inline bool any(Mask a)							{ return _mm256_movemask_ps(a._m) != 0; }
+		/// @brief Returns a where the mask is set, b elsewhere.
+		inline Float select(Mask m, Float a, Float b)	{ return {_mm256_blendv_ps(b._v, a._v, m._m)}; }
+
+		/// @brief Returns 2^n for integral n in [-126, 127].
+		inline Float pow2(Float n)
+		{
+			return {_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n._v), _mm256_set1_epi32(127)), 23))};
+		}
+		/// @brief Splits normalized positive a into a mantissa in [0.5, 1), which is returned, and an exponent.
+		inline Float frexp(Float a, Float& exponent)
+		{
+			auto bits = _mm256_castps_si256(a._v);
+			exponent._v = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+			return {_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)))};
+		}
+#else
+		static constexpr size_t lanes = 8;
+		/// False for the fallback, which is slower than processing the lanes one after another.
+		static constexpr bool vectorized = false;
+
+		struct Float { std::array<float, lanes> _v; };
+		struct Mask { std::array<bool, lanes> _m; };
+
+		inline Float broadcast(float x)					{ Float r; r._v.fill(x); return r; }
+		inline Float load(const float* p)				{ Float r; std::memcpy(r._v.data(), p, sizeof(r._v)); return r; }
+		inline void store(float* p, Float a)			{ std::memcpy(p, a._v.data(), sizeof(a._v)); }
+
+#define VIS_SIMD_UTIL_LANEWISE(result_type, expression) \
+		result_type r; \
+		for(size_t l = 0; l < lanes; ++l) \
+			r expression; \
+		return r;
+
+		inline Float operator+(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = a._v[l] + b._v[l]) }
+		inline Float operator-(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = a._v[l] - b._v[l]) }
+		inline Float operator*(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = a._v[l] * b._v[l]) }
+		inline Float operator/(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = a._v[l] / b._v[l]) }
+		/// @brief Returns a*b + c.
+		inline Float mul_add(Float a, Float b, Float c)	{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = a._v[l] * b._v[l] + c._v[l]) }
+		inline Float min(Float a, Float b)				{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = (a._v[l] < b._v[l]) ? a._v[l] : b._v[l]) }
+		inline Float max(Float a, Float b)				{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = (a._v[l] > b._v[l]) ? a._v[l] : b._v[l]) }
+		inline Float sqrt(Float a)						{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = std::sqrt(a._v[l])) }
+		inline Float abs(Float a)						{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = std::abs(a._v[l])) }
+		inline Float round(Float a)						{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = std::nearbyint(a._v[l])) }
+
+		inline Mask operator<(Float a, Float b)			{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = a._v[l] < b._v[l]) }
+		inline Mask operator<=(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = a._v[l] <= b._v[l]) }
+		inline Mask operator==(Float a, Float b)		{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = a._v[l] == b._v[l]) }
+		inline Mask operator&(Mask a, Mask b)			{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = a._m[l] && b._m[l]) }
+		inline Mask operator|(Mask a, Mask b)			{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = a._m[l] || b._m[l]) }
+		inline Mask operator!(Mask a)					{ VIS_SIMD_UTIL_LANEWISE(Mask, ._m[l] = !a._m[l]) }
+		inline Mask all_lanes()							{ Mask r; r._m.fill(true); return r; }
+		inline bool any(Mask a)							{ for(auto m : a._m) if(m) return true; return false; }
+		/// @brief Returns a where the mask is set, b elsewhere.
+		inline Float select(Mask m, Float a, Float b)	{ VIS_SIMD_UTIL_LANEWISE(Float, ._v[l] = m._m[l] ? a._v[l] : b._v[l]) }
+
+		/// @brief Returns 2^n for integral n in [-126, 127].
+		inline Float pow2(Float n)
+		{
+			Float r;
+			for(size_t l = 0; l < lanes; ++l)
+			{
+				auto bits = static_cast<std::uint32_t>(static_cast<std::int32_t>(n._v[l]) + 127) << 23;
+				std::memcpy(&r._v[l], &bits, sizeof(bits));
+			}
+			return r;
+		}
+		/// @brief Splits normalized positive a into a mantissa in [0.5, 1), which is returned, and an exponent.
+		inline Float frexp(Float a, Float& exponent)
+		{
+			Float r;
+			for(size_t l = 0; l < lanes; ++l)
+			{
+				std::uint32_t bits;
+				std::memcpy(&bits, &a._v[l], sizeof(bits));
+				exponent._v[l] = static_cast<float>(static_cast<std::int32_t>(bits >> 23) - 126);
+				bits = (bits & 0x007fffffu) | 0x3f000000u;
+				std::memcpy(&r._v[l], &bits, sizeof(bits));
+			}
+			return r;
+		}
+
+#undef VIS_SIMD_UTIL_LANEWISE
+#endif
+
+		/// @brief Stores the lanes of a into an array.
+		inline std::array<float, lanes> to_array(Float a)
+		{
+			auto result = std::array<float, lanes>{};
+			store(result.data(), a);
+			return result;
+		}
+
+		/**
+		 * @brief exp Approximates e^x in every lane (Cephes polynomial, about 1 ulp for x <= 88).
+		 * Lanes below the smallest normalized result are flushed to zero, NaN lanes stay NaN.
+		 */
+		inline Float exp(Float x)
+		{
+			auto nan = !(x == x);
+			const auto lower_bound = broadcast(-87.3365478515625f);
+			auto underflow = x < lower_bound;
+			x = min(max(x, lower_bound), broadcast(88.f));
+
+			// x = n*ln(2) + r, with |r| <= ln(2)/2
+			auto n = round(x * broadcast(1.44269504088896341f));
+			auto r = mul_add(n, broadcast(-0.693359375f), x);
+			r = mul_add(n, broadcast(2.12194440e-4f), r);
+
+			auto p = broadcast(1.9875691500e-4f);
+			p = mul_add(p, r, broadcast(1.3981999507e-3f));
+			p = mul_add(p, r, broadcast(8.3334519073e-3f));
+			p = mul_add(p, r, broadcast(4.1665795894e-2f));
+			p = mul_add(p, r, broadcast(1.6666665459e-1f));
+			p = mul_add(p, r, broadcast(5.0000001201e-1f));
+			p = mul_add(p, r * r, r) + broadcast(1.f);
+
+			return select(nan, x, select(underflow, broadcast(0.f), p * pow2(n)));
+		}
+
+		/**
+		 * @brief log Approximates the natural logarithm in every lane (Cephes polynomial, about 1 ulp).
+		 * Returns -inf for zero, NaN for negative and NaN lanes and inf for infinite lanes.
+		 */
+		inline Float log(Float x)
+		{
+			// Scale denormals into the normalized range
+			auto denormal = x < broadcast(std::numeric_limits<float>::min());
+			auto scaled = select(denormal, x * broadcast(8388608.f), x);
+
+			auto exponent = broadcast(0.f);
+			auto m = frexp(scaled, exponent);
+			exponent = select(denormal, exponent - broadcast(23.f), exponent);
+
+			// Map the mantissa to [sqrt(0.5)-1, sqrt(2)-1)
+			auto small = m < broadcast(0.707106781186547524f);
+			exponent = select(small, exponent - broadcast(1.f), exponent);
+			m = select(small, m + m, m) - broadcast(1.f);
+
+			auto z = m * m;
+			auto p = broadcast(7.0376836292e-2f);
+			p = mul_add(p, m, broadcast(-1.1514610310e-1f));
+			p = mul_add(p, m, broadcast(1.1676998740e-1f));
+			p = mul_add(p, m, broadcast(-1.2420140846e-1f));
+			p = mul_add(p, m, broadcast(1.4249322787e-1f));
+			p = mul_add(p, m, broadcast(-1.6668057665e-1f));
+			p = mul_add(p, m, broadcast(2.0000714765e-1f));
+			p = mul_add(p, m, broadcast(-2.4999993993e-1f));
+			p = mul_add(p, m, broadcast(3.3333331174e-1f));
+			auto y = p * m * z;
+			y = mul_add(exponent, broadcast(-2.12194440e-4f), y);
+			y = mul_add(z, broadcast(-.5f), y);
+			auto result = mul_add(exponent, broadcast(0.693359375f), m + y);
+
+			const auto zero = broadcast(0.f);
+			const auto infinity = broadcast(std::numeric_limits<float>::infinity());
+			result = select(x == infinity, infinity, result);
+			result = select(x == zero, broadcast(-std::numeric_limits<float>::infinity()), result);
+			return select((x < zero) | !(x == x), broadcast(std::numeric_limits<float>::quiet_NaN()), result);
+		}
+	}
+}
+
+#endif // SIMD_UTIL_H
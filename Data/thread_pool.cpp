@@ -0,0 +1,147 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace vis
+{
+	ThreadPool::ThreadPool(size_t thread_count)
+	{
+		if(thread_count == 0)
+			thread_count = std::max(static_cast<size_t>(std::thread::hardware_concurrency()), size_t{1});
+
+		for(size_t t = 0; t < thread_count; ++t)
+			_ranges.push_back(std::make_unique<Range>());
+		for(size_t t = 0; t < thread_count; ++t)
+			_threads.emplace_back([this, t] () { work(t); });
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			auto lock = std::lock_guard<std::mutex>{_mutex};
+			_stop = true;
+		}
+		_start.notify_all();
+		for(auto& thread : _threads)
+			thread.join();
+	}
+
+	size_t ThreadPool::thread_count() const		{ return _threads.size(); }
+
+	void ThreadPool::parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t, size_t)>& task)
+	{
+		if(count == 0)
+			return;
+
+		auto loop_lock = std::lock_guard<std::mutex>{_loop_mutex};
+
+		// Split evenly, stealing balances the rest
+		for(size_t t = 0; t < _ranges.size(); ++t)
+		{
+			auto lock = std::lock_guard<std::mutex>{_ranges[t]->_mutex};
+			_ranges[t]->_begin = count * t / _ranges.size();
+			_ranges[t]->_end = count * (t+1) / _ranges.size();
+		}
+
+		auto lock = std::unique_lock<std::mutex>{_mutex};
+		_task = &task;
+		_chunk_size = std::max(chunk_size, size_t{1});
+		_error = nullptr;
+		_active = _threads.size();
+		++_generation;
+		_start.notify_all();
+		_done.wait(lock, [this] () { return _active == 0; });
+		_task = nullptr;
+
+		if(_error)
+			std::rethrow_exception(_error);
+	}
+
+	void ThreadPool::work(size_t worker)
+	{
+		size_t generation = 0;
+		while(true)
+		{
+			{
+				auto lock = std::unique_lock<std::mutex>{_mutex};
+				_start.wait(lock, [this, generation] () { return _stop || _generation != generation; });
+				if(_stop)
+					return;
+				generation = _generation;
+			}
+
+			size_t begin = 0;
+			size_t end = 0;
+			while(next_chunk(worker, begin, end))
+			{
+				try
+				{
+					(*_task)(begin, end, worker);
+				}
+				catch(...)
+				{
+					{
+						auto lock = std::lock_guard<std::mutex>{_mutex};
+						if(!_error)
+							_error = std::current_exception();
+					}
+					clear_ranges();
+				}
+			}
+
+			auto lock = std::lock_guard<std::mutex>{_mutex};
+			if(--_active == 0)
+				_done.notify_one();
+		}
+	}
+
+	bool ThreadPool::next_chunk(size_t worker, size_t& begin, size_t& end)
+	{
+		auto& own = *_ranges[worker];
+		while(true)
+		{
+			// Take from the own range first
+			{
+				auto lock = std::lock_guard<std::mutex>{own._mutex};
+				if(own._begin < own._end)
+				{
+					begin = own._begin;
+					end = std::min(own._begin + _chunk_size, own._end);
+					own._begin = end;
+					return true;
+				}
+			}
+
+			// Steal the upper half of the next non-empty range
+			auto stolen_begin = size_t{0};
+			auto stolen_end = size_t{0};
+			for(size_t v = 1; v < _ranges.size() && stolen_begin == stolen_end; ++v)
+			{
+				auto& victim = *_ranges[(worker + v) % _ranges.size()];
+				auto lock = std::lock_guard<std::mutex>{victim._mutex};
+				if(victim._begin < victim._end)
+				{
+					auto remaining = victim._end - victim._begin;
+					stolen_end = victim._end;
+					stolen_begin = (remaining <= _chunk_size) ? victim._begin : victim._begin + remaining / 2;
+					victim._end = stolen_begin;
+				}
+			}
+			if(stolen_begin == stolen_end)
+				return false;
+
+			auto lock = std::lock_guard<std::mutex>{own._mutex};
+			own._begin = stolen_begin;
+			own._end = stolen_end;
+		}
+	}
+
+	void ThreadPool::clear_ranges()
+	{
+		for(auto& range : _ranges)
+		{
+			auto lock = std::lock_guard<std::mutex>{range->_mutex};
+			range->_begin = range->_end;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <exception>
+
+namespace vis
+{
+	/**
+	 * @brief The ThreadPool class runs parallel loops on a fixed set of reusable threads.
+	 * Every loop is split evenly between the threads. A thread that runs out of work steals half of
+	 * the remaining range of another thread, so ranges of differing cost do not leave threads idle.
+	 */
+	class ThreadPool
+	{
+	public:
+		/**
+		 * @brief ThreadPool Starts the threads.
+		 * @param thread_count The number of threads. If 0, the hardware concurrency is used.
+		 */
+		explicit ThreadPool(size_t thread_count = 0);
+
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+
+		/**
+		 * @brief ~ThreadPool Stops and joins the threads.
+		 */
+		~ThreadPool();
+
+		/// @brief Returns the number of threads.
+		size_t thread_count() const;
+
+		/**
+		 * @brief parallel_for Calls task(begin, end, worker) for chunks of [0, count) and blocks until all chunks are done.
+		 * worker in [0, thread_count()) identifies the calling thread, so tasks can use per-thread state.
+		 * Rethrows the first exception thrown by a task, remaining chunks are skipped in that case.
+		 * Must not be called from inside of a task.
+		 * @param count The number of indices.
+		 * @param chunk_size The maximum number of indices passed to one task call.
+		 * @param task The task.
+		 */
+		void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t, size_t)>& task);
+
+	private:
+		/**
+		 * @brief The Range struct holds the indices that are still to be processed by one thread.
+		 */
+		struct Range
+		{
+			std::mutex _mutex{};
+			size_t _begin{0};
+			size_t _end{0};
+		};
+
+		void work(size_t worker);
+		/// @brief Takes the next chunk of the workers range, stealing from other ranges if it is empty.
+		bool next_chunk(size_t worker, size_t& begin, size_t& end);
+		/// @brief Empties all ranges, so the running loop finishes early.
+		void clear_ranges();
+
+		std::vector<std::thread> _threads{};
+		std::vector<std::unique_ptr<Range>> _ranges{};
+
+		std::mutex _loop_mutex{};	///< Serializes calls of parallel_for.
+		std::mutex _mutex{};
+		std::condition_variable _start{};
+		std::condition_variable _done{};
+
+		const std::function<void(size_t, size_t, size_t)>* _task{nullptr};
+		size_t _chunk_size{1};
+		size_t _generation{0};
+		size_t _active{0};
+		bool _stop{false};
+		std::exception_ptr _error{};
+	};
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,79 @@
+#define GSL_THROW_ON_CONTRACT_VIOLATION
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "Data/math_util.h"
+
+using namespace vis;
+
+/**
+ * Compares math_util::fit_gmm_binned with the exact math_util::fit_gmm on points with one to three modes and many samples.
+ * Fails, if the binned fits pick another number of components for too many points, or their components deviate too far
+ * from the exact ones, measured as fractions of the range of the samples of a point.
+ */
+int main()
+{
+	static constexpr int num_points = 400;
+	static constexpr size_t num_samples = 10000;
+	static constexpr unsigned max_components = 4;
+	static constexpr double min_agreement = .98;
+	static constexpr double max_mean_error = 1e-3;
+	static constexpr double max_deviation_error = 1e-3;
+
+	auto random = std::mt19937{7};
+	auto uniform = std::uniform_real_distribution<float>{-5.f, 5.f};
+	auto samples = std::vector<std::vector<float>>(num_points);
+	for(int p = 0; p < num_points; ++p)
+	{
+		auto num_modes = 1 + p % 3;
+		auto modes = std::vector<std::normal_distribution<float>>{};
+		for(int m = 0; m < num_modes; ++m)
+			modes.emplace_back(uniform(random) * 2.f, .5f + std::abs(uniform(random)) / 5.f);
+
+		samples[p].resize(num_samples);
+		for(auto& sample : samples[p])
+			sample = modes[random() % modes.size()](random);
+		std::sort(samples[p].begin(), samples[p].end());
+	}
+
+	auto workspace = math_util::GMMWorkspace{};
+	auto exact = std::vector<math_util::GMMComponent>{};
+	auto binned = std::vector<math_util::GMMComponent>{};
+	auto weighted = [] (const auto& gmm) { return std::count_if(gmm.begin(), gmm.end(), [] (const auto& c) { return c._weight != 0.f; }); };
+
+	auto agreeing_points = 0;
+	auto compared_components = 0;
+	auto mean_error = 0.;
+	auto deviation_error = 0.;
+	for(const auto& point : samples)
+	{
+		math_util::fit_gmm(point, max_components, workspace, exact);
+		math_util::fit_gmm_binned(point, max_components, math_util::fit_gmm_default_bins, {}, workspace, binned);
+		if(weighted(exact) != weighted(binned))
+			continue;
+
+		++agreeing_points;
+		auto range = static_cast<double>(point.back() - point.front());
+		for(size_t c = 0; c < exact.size(); ++c)
+		{
+			if(exact[c]._weight == 0.f)
+				continue;
+			mean_error += std::abs(exact[c]._mean - binned[c]._mean) / range;
+			deviation_error += std::abs(std::sqrt(exact[c]._variance) - std::sqrt(binned[c]._variance)) / range;
+			++compared_components;
+		}
+	}
+	mean_error /= compared_components;
+	deviation_error /= compared_components;
+
+	std::cout << "Same number of components for " << agreeing_points << " of " << num_points << " points\n"
+			  << "Mean error: " << mean_error << ", deviation error: " << deviation_error << " of the sample range\n";
+
+	auto passed = agreeing_points >= min_agreement * num_points && mean_error <= max_mean_error && deviation_error <= max_deviation_error;
+	std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,20 @@
+TEMPLATE = app
+CONFIG += c++17
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+LIBS += -lpthread
+
+INCLUDEPATH += ..
+
+SOURCES += gmm_binned_test.cpp \
+    ../logger.cpp \
+    ../Data/math_util.cpp \
+    ../Data/field.cpp
+
+HEADERS += \
+    ../logger.h \
+    ../Data/math_util.h \
+    ../Data/field.h \
+    ../Data/simd_util.h
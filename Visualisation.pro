@@ -11,6 +11,12 @@ LIBS += -lGL \
 		-lpthread \
 		-lfreetype
 
+# Run qmake with CONFIG+=native to enable the AVX2 and AVX-512 paths of the batched GMM fit.
+# The binaries then only run on CPUs with the instruction sets of the build machine.
+native {
+	QMAKE_CXXFLAGS_RELEASE += -march=native
+}
+
 # Adapt to your freetype2 include directory
 INCLUDEPATH += /usr/include/freetype2
 
@@ -30,6 +36,10 @@ SOURCES += main.cpp \
     Data/math_util.cpp \
     Data/ensemble.cpp \
     Data/field.cpp \
+    Data/io_util.cpp \
+    Data/mapped_file.cpp \
+    Data/sample_matrix.cpp \
+    Data/thread_pool.cpp \
     Renderer/glyph.cpp \
     Renderer/render_util.cpp \
     Renderer/glyphgmm.cpp \
@@ -48,6 +58,11 @@ HEADERS += \
     Data/math_util.h \
     Data/ensemble.h \
     Data/field.h \
+    Data/io_util.h \
+    Data/mapped_file.h \
+    Data/sample_matrix.h \
+    Data/thread_pool.h \
+    Data/simd_util.h \
     Renderer/glyph.h \
     Renderer/render_util.h \
     Renderer/glyphgmm.h \
@@ -1,6 +1,7 @@
 #include "logger.h"
 
 #include <map>
+#include <ctime>
 
 namespace vis
 {
@@ -18,33 +19,50 @@ namespace vis
 	Logger& Logger::instance()
 	{
 		static Logger instance{};
-		if(*instance._stream)
-			*instance._stream << '\n';
 		return instance;
 	}
 
-	Logger& Logger::log(const Logger::Severity& severity)
+	Logger::Message::Message(Logger& logger, Severity severity)
+		: _logger{logger},
+		  _lock{logger._mutex}
 	{
-		return instance() << severity;
+		if(!_logger._stream)
+			return;
+
+		// std::localtime shares its result between threads
+		auto timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		auto time = std::tm{};
+#ifdef _WIN32
+		localtime_s(&time, &timestamp);
+#else
+		localtime_r(&timestamp, &time);
+#endif
+		*_logger._stream << '\n' << std::put_time(&time, "%F %T ") << severity_string(severity) << ' ';
+	}
+
+	Logger::Message Logger::log(const Logger::Severity& severity)
+	{
+		return Message{instance(), severity};
 	}
 
-	Logger& Logger::error()
+	Logger::Message Logger::error()
 	{
-		return instance() << Severity::ERROR;
+		return log(Severity::ERROR);
 	}
 
-	Logger& Logger::warning()
+	Logger::Message Logger::warning()
 	{
-		return instance() << Severity::WARNING;
+		return log(Severity::WARNING);
 	}
 
-	Logger& Logger::debug()
+	Logger::Message Logger::debug()
 	{
-		return instance() << Severity::DEBUG;
+		return log(Severity::DEBUG);
 	}
 
 	void Logger::set_stream(std::ostream* stream)
 	{
+		auto lock = std::lock_guard<std::recursive_mutex>{_mutex};
 		_stream = stream;
 	}
 
@@ -56,10 +74,4 @@ namespace vis
 			{Logger::Severity::DEBUG, "DEBUG  "}};
 		return sevMap.at(severity);
 	}
-
-	Logger& Logger::operator<<(const Severity& severity)
-	{
-		_severity = severity;
-		return *this;
-	}
 }
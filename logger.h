@@ -5,6 +5,7 @@
 #include <iostream>
 #include <chrono>
 #include <iomanip>
+#include <mutex>
 
 
 namespace vis
@@ -32,48 +33,53 @@ namespace vis
 		static Logger& instance();
 
 		/**
-		 * @brief log Returns a reference to the single static instance of the Logger and sets the severity.
+		 * @brief The Message class writes a single message while it holds the lock of the logger.
+		 * It is returned by log, error, warning and debug and writes the timestamp and severity on construction.
+		 * Values streamed into it are appended to the message. The lock is released when the message is destroyed,
+		 * at the end of the logging statement, so messages of different threads never interleave.
 		 */
-		static Logger& log(const Severity& severity);
-		/**
-		 * @brief Returns a reference to the single static instance of the Logger and sets the severity to ERROR.
-		 */
-		static Logger& error();
+		class Message
+		{
+		public:
+			explicit Message(Logger& logger, Severity severity);
+
+			template<typename T>
+			/**
+			 * @brief operator << Appends @param value to the message.
+			 */
+			Message& operator<<(const T& value)
+			{
+				if(_logger._stream)
+					*_logger._stream << value;
+				return *this;
+			}
+
+		private:
+			Logger& _logger;
+			std::unique_lock<std::recursive_mutex> _lock;
+		};
+
 		/**
-		 * @brief debug Returns a reference to the single static instance of the Logger and sets the severity to DEBUG.
+		 * @brief log Starts a message of the given severity.
 		 */
-		static Logger& debug();
+		static Message log(const Severity& severity);
 		/**
-		 * @brief warning Returns a reference to the single static instance of the Logger and sets the severity to WARNING.
+		 * @brief error Starts a message with severity ERROR.
 		 */
-		static Logger& warning();
-
+		static Message error();
 		/**
-		 * @brief setStream Sets the stream (default is std::cout) to which all messages will be sent.
+		 * @brief debug Starts a message with severity DEBUG.
 		 */
-		void set_stream(std::ostream* stream);
-
+		static Message debug();
 		/**
-		 * @brief operator << Sets _severity to @param severity and returns a reference to this logger.
+		 * @brief warning Starts a message with severity WARNING.
 		 */
-		Logger& operator<<(const Severity& severity);
+		static Message warning();
 
-		template<typename T>
 		/**
-		 * @brief operator << prints @param message to _stream.
-		 * @return Returns a reference to the stream.
+		 * @brief setStream Sets the stream (default is std::cout) to which all messages will be sent.
 		 */
-		std::ostream& operator<<(const T& message)
-		{
-			auto timestamp = std::chrono::system_clock::now();
-			auto timestamp_clock = std::chrono::system_clock::to_time_t(timestamp);
-			if(_stream)
-				*_stream << std::put_time(std::localtime(&timestamp_clock), "%F %T ")
-						 << severity_string(_severity)
-						 << " "
-						 << message;
-			return *_stream;
-		}
+		void set_stream(std::ostream* stream);
 
 	private:
 		explicit Logger();
@@ -106,8 +112,8 @@ namespace vis
 		static std::string severity_string(Severity severity);
 
 
-		/// Current severity.
-		Severity _severity{Severity::DEBUG};
+		/// Guards the stream. Recursive, so values that log while they are streamed into a message do not deadlock.
+		std::recursive_mutex _mutex;
 		/// Not owning pointer to output stream.
 		/// All messages will be sent to this stream.
 		std::ostream* _stream{&std::cout};